@@ -0,0 +1,94 @@
+#include "BucketGrid.h"
+#include <climits>
+
+using namespace std;
+
+BucketGrid::BucketGrid()
+	: left(0), top(0), right(-1), bottom(-1), bucketsX(0), bucketsY(0)
+{
+}
+
+BucketGrid::~BucketGrid()
+{
+}
+
+void BucketGrid::Clear()
+{
+	left = top = 0;
+	right = bottom = -1;
+	bucketsX = bucketsY = 0;
+	rects.clear();
+	bucketStart.clear();
+	bucketItems.clear();
+}
+
+void BucketGrid::Build(const vector<TileRect>& rects)
+{
+	int l = INT_MAX, t = INT_MAX, r = INT_MIN, b = INT_MIN;
+	for (auto i = rects.begin(); i != rects.end(); ++i)
+	{
+		if (i->right < i->left || i->bottom < i->top) continue;
+		l = min(l, i->left);
+		t = min(t, i->top);
+		r = max(r, i->right);
+		b = max(b, i->bottom);
+	}
+	if (l > r)
+	{
+		Clear();
+		return;
+	}
+
+	this->rects = rects;
+	left = l;
+	top = t;
+	right = r;
+	bottom = b;
+	bucketsX = ((right - left) >> BucketShift) + 1;
+	bucketsY = ((bottom - top) >> BucketShift) + 1;
+	bucketStart.assign(bucketsX * bucketsY + 1, 0);
+
+	auto for_each_bucket = [this](const TileRect& rect, auto visit)
+	{
+		if (rect.right < rect.left || rect.bottom < rect.top) return;
+		for (int by = BucketY(rect.top); by <= BucketY(rect.bottom); ++by)
+		{
+			for (int bx = BucketX(rect.left); bx <= BucketX(rect.right); ++bx)
+			{
+				visit(by * bucketsX + bx);
+			}
+		}
+	};
+
+	for (auto i = rects.begin(); i != rects.end(); ++i)
+	{
+		for_each_bucket(*i, [this](int k) { ++bucketStart[k + 1]; });
+	}
+	for (size_t k = 1; k < bucketStart.size(); ++k)
+	{
+		bucketStart[k] += bucketStart[k - 1];
+	}
+
+	bucketItems.resize(bucketStart.back());
+	vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		for_each_bucket(rects[i], [this, &fill, i](int k) { bucketItems[fill[k]++] = (int)i; });
+	}
+}
+
+int BucketGrid::Find(int x, int y) const
+{
+	if (rects.empty() || x < left || x > right || y < top || y > bottom) return -1;
+
+	const int b = BucketY(y) * bucketsX + BucketX(x);
+	for (int k = bucketStart[b]; k < bucketStart[b + 1]; ++k)
+	{
+		const TileRect& r = rects[bucketItems[k]];
+		if (x >= r.left && x <= r.right && y >= r.top && y <= r.bottom)
+		{
+			return bucketItems[k];
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "RectUnion.h"
+#include <algorithm>
+#include <vector>
+
+// Index of inclusive tile rectangles by the 16 x 16 tile buckets they overlap. Every bucket lists its
+// rectangles contiguously and in index order, so point queries see lower indices first.
+class BucketGrid
+{
+public:
+	BucketGrid();
+	~BucketGrid();
+
+	void Build(const std::vector<TileRect>& rects);
+	void Clear();
+
+	// lowest index of a rectangle containing the tile, -1 if none
+	int Find(int x, int y) const;
+
+	// calls visit(i) once for every rectangle i overlapping r, in bucket order
+	template <typename Visit>
+	void ForEachOverlap(const TileRect& r, Visit visit) const
+	{
+		if (rects.empty() || r.right < left || r.left > right || r.bottom < top || r.top > bottom) return;
+
+		const int bx0 = BucketX(r.left), bx1 = BucketX(r.right);
+		const int by0 = BucketY(r.top), by1 = BucketY(r.bottom);
+		for (int by = by0; by <= by1; ++by)
+		{
+			for (int bx = bx0; bx <= bx1; ++bx)
+			{
+				const int b = by * bucketsX + bx;
+				for (int k = bucketStart[b]; k < bucketStart[b + 1]; ++k)
+				{
+					const TileRect& q = rects[bucketItems[k]];
+					if (q.right < r.left || q.left > r.right || q.bottom < r.top || q.top > r.bottom) continue;
+
+					// a rectangle spanning several buckets is reported from the one holding the top left
+					// corner of the overlap
+					if (BucketX(std::max(q.left, r.left)) != bx || BucketY(std::max(q.top, r.top)) != by) continue;
+					visit(bucketItems[k]);
+				}
+			}
+		}
+	}
+
+	const std::vector<TileRect>& GetRects() const { return rects; }
+
+private:
+	int BucketX(int x) const { return (std::min(std::max(x, left), right) - left) >> BucketShift; }
+	int BucketY(int y) const { return (std::min(std::max(y, top), bottom) - top) >> BucketShift; }
+
+private:
+	static const int		BucketShift = 4;
+
+	int						left;
+	int						top;
+	int						right;
+	int						bottom;
+	int						bucketsX;
+	int						bucketsY;
+
+	std::vector<TileRect>	rects;
+	std::vector<int>		bucketStart;
+	std::vector<int>		bucketItems;
+};
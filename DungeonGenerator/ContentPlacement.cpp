@@ -0,0 +1,198 @@
+#include "ContentPlacement.h"
+#include "BucketGrid.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+	// area kept free of points, [left, right) x [top, bottom) grown by the clearance
+	struct KeepOut
+	{
+		float left, top, right, bottom;
+	};
+
+	bool InKeepOut(const vector<KeepOut>& keepOuts, float clearance, float x, float y)
+	{
+		for (auto k = keepOuts.begin(); k != keepOuts.end(); ++k)
+		{
+			float dx = max(max(k->left - x, x - k->right), 0.0f);
+			float dy = max(max(k->top - y, y - k->bottom), 0.0f);
+			if (dx * dx + dy * dy < clearance * clearance) return true;
+		}
+		return false;
+	}
+
+	void AddTile(vector<KeepOut>& keepOuts, int x, int y)
+	{
+		keepOuts.push_back({ (float)x, (float)y, (float)x + 1, (float)y + 1 });
+	}
+
+	// tiles where the corridor crosses the wall ring of the room, empty when it only passes by
+	void AddMouths(vector<KeepOut>& keepOuts, const Cell& room, const Corridor& corridor)
+	{
+		int l, t, r, b;
+		corridor.rect(l, t, r, b);
+
+		const int rl = room.x, rt = room.y, rr = room.x + room.width - 1, rb = room.y + room.height - 1;
+		l = max(l, rl);
+		t = max(t, rt);
+		r = min(r, rr);
+		b = min(b, rb);
+		if (l > r || t > b) return;
+
+		if (t == rt) keepOuts.push_back({ (float)l, (float)rt, (float)r + 1, (float)rt + 1 });
+		if (b == rb) keepOuts.push_back({ (float)l, (float)rb, (float)r + 1, (float)rb + 1 });
+		if (l == rl) keepOuts.push_back({ (float)rl, (float)t, (float)rl + 1, (float)b + 1 });
+		if (r == rr) keepOuts.push_back({ (float)rr, (float)t, (float)rr + 1, (float)b + 1 });
+	}
+
+	// Bridson's sampling over [left, right) x [top, bottom), on a background grid of cells small
+	// enough to hold a single point, so a candidate only checks the 5 x 5 cells around it
+	void SampleRoom(float left, float top, float right, float bottom, float minDistance, float clearance, int attempts,
+		const vector<KeepOut>& keepOuts, default_random_engine& generator, vector<ContentPoint>& out)
+	{
+		const float cellSize = minDistance / sqrt(2.0f);
+		const int gridW = max((int)ceil((right - left) / cellSize), 1);
+		const int gridH = max((int)ceil((bottom - top) / cellSize), 1);
+		vector<int> grid(gridW * gridH, -1);
+		vector<int> active;
+
+		uniform_real_distribution<float> distX(left, right);
+		uniform_real_distribution<float> distY(top, bottom);
+		uniform_real_distribution<float> distAngle(0.0f, 6.2831853f);
+		uniform_real_distribution<float> distRadius(minDistance, minDistance * 2);
+
+		auto try_add = [&](float x, float y) -> bool
+		{
+			if (x < left || x >= right || y < top || y >= bottom) return false;
+			if (InKeepOut(keepOuts, clearance, x, y)) return false;
+
+			int gx = min((int)((x - left) / cellSize), gridW - 1);
+			int gy = min((int)((y - top) / cellSize), gridH - 1);
+			for (int j = max(gy - 2, 0); j <= min(gy + 2, gridH - 1); ++j)
+			{
+				for (int i = max(gx - 2, 0); i <= min(gx + 2, gridW - 1); ++i)
+				{
+					int p = grid[j * gridW + i];
+					if (p < 0) continue;
+					float dx = out[p].x - x, dy = out[p].y - y;
+					if (dx * dx + dy * dy < minDistance * minDistance) return false;
+				}
+			}
+
+			grid[gy * gridW + gx] = (int)out.size();
+			active.push_back((int)out.size());
+			out.push_back({ x, y });
+			return true;
+		};
+
+		// scattered starting points, so areas cut off by a keep-out still get sampled
+		for (int i = 0; i < attempts; ++i)
+		{
+			float x = distX(generator);
+			float y = distY(generator);
+			try_add(x, y);
+		}
+
+		while (!active.empty())
+		{
+			uniform_int_distribution<size_t> pick(0, active.size() - 1);
+			size_t a = pick(generator);
+			const ContentPoint center = out[active[a]];
+
+			bool added = false;
+			for (int i = 0; i < attempts && !added; ++i)
+			{
+				float angle = distAngle(generator);
+				float radius = distRadius(generator);
+				added = try_add(center.x + radius * cos(angle), center.y + radius * sin(angle));
+			}
+
+			if (!added)
+			{
+				active[a] = active.back();
+				active.pop_back();
+			}
+		}
+	}
+}
+
+ContentPlacement::ContentPlacement()
+{
+}
+
+ContentPlacement::~ContentPlacement()
+{
+}
+
+void ContentPlacement::Place(const MapGenerator& gen, unsigned int seed, float minDistance, float clearance, int attempts, unsigned int threadCount)
+{
+	roomCells.clear();
+	firstPoint.assign(1, 0);
+	points.clear();
+
+	if (!gen.IsFinished() || minDistance <= 0) return;
+
+	const vector<Cell>& cells = gen.GetCells();
+	for (size_t i = 0; i < cells.size(); ++i)
+	{
+		if (cells[i].room && !cells[i].discard) roomCells.push_back((int)i);
+	}
+
+	const int roomCount = (int)roomCells.size();
+	if (roomCount == 0) return;
+
+	// merged corridors by the buckets their rectangles cover, so every room only checks the corridors
+	// near it
+	const vector<Corridor>& corridors = gen.GetMergedCorridors();
+	vector<TileRect> corridorRects(corridors.size());
+	for (size_t i = 0; i < corridors.size(); ++i)
+	{
+		TileRect& r = corridorRects[i];
+		corridors[i].rect(r.left, r.top, r.right, r.bottom);
+	}
+	BucketGrid corridorIndex;
+	corridorIndex.Build(corridorRects);
+
+	vector<vector<ContentPoint>> roomPoints(roomCount);
+
+	ParallelFor(roomCount, threadCount, [&](int r)
+	{
+		const Cell& room = cells[roomCells[r]];
+
+		// the wall ring stays clear, as Gen2DArrayMap draws it
+		const float left = (float)room.x + 1, top = (float)room.y + 1;
+		const float right = (float)(room.x + room.width - 1), bottom = (float)(room.y + room.height - 1);
+		if (right <= left || bottom <= top) return true;
+
+		vector<KeepOut> keepOuts;
+		AddTile(keepOuts, gen.EntryX(), gen.EntryY());
+		AddTile(keepOuts, gen.ExitX(), gen.ExitY());
+		const TileRect bounds = { room.x, room.y, room.x + room.width - 1, room.y + room.height - 1 };
+		corridorIndex.ForEachOverlap(bounds, [&](int c) { AddMouths(keepOuts, room, corridors[c]); });
+
+		default_random_engine generator(RoomSeed(seed, roomCells[r]));
+		SampleRoom(left, top, right, bottom, minDistance, clearance, attempts, keepOuts, generator, roomPoints[r]);
+		return true;
+	});
+
+	firstPoint.resize(roomCount + 1);
+	for (int r = 0; r < roomCount; ++r)
+	{
+		firstPoint[r + 1] = firstPoint[r] + (int)roomPoints[r].size();
+	}
+	points.resize(firstPoint[roomCount]);
+	for (int r = 0; r < roomCount; ++r)
+	{
+		copy(roomPoints[r].begin(), roomPoints[r].end(), points.begin() + firstPoint[r]);
+	}
+}
+
+unsigned int ContentPlacement::RoomSeed(unsigned int seed, int cell)
+{
+	return MapGenerator::DeriveSeed(seed, cell);
+}
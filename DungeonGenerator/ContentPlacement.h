@@ -0,0 +1,42 @@
+#pragma once
+
+#include "MapGenerator.h"
+#include <vector>
+
+// position in map coordinates, the point lies on tile (floor(x), floor(y))
+struct ContentPoint
+{
+	float x;
+	float y;
+};
+
+// Scatters props, loot and spawn points over the room interiors of a finished map with Bridson's
+// Poisson-disk sampling. Rooms are sampled independently on several threads, each from its own
+// seed derived from the placement seed and the room's cell index, so the points don't depend on
+// the number of threads or on the other rooms.
+class ContentPlacement
+{
+public:
+	ContentPlacement();
+	~ContentPlacement();
+
+	// points at least minDistance apart and at least clearance away from the entry, the exit and
+	// the corridor mouths in the room walls; call GenEntryAndExit first. attempts is the number of
+	// candidates tried around every point before it is retired, threadCount == 0 uses all cores
+	void Place(const MapGenerator& gen, unsigned int seed, float minDistance, float clearance, int attempts = 30, unsigned int threadCount = 0);
+
+	int GetRoomCount() const { return (int)roomCells.size(); }
+	// cell index of every room
+	const std::vector<int>& GetRoomCells() const { return roomCells; }
+
+	// points of room r are points[firstPoint[r]] .. points[firstPoint[r + 1] - 1]
+	const std::vector<int>& GetFirstPoint() const { return firstPoint; }
+	const std::vector<ContentPoint>& GetPoints() const { return points; }
+
+	static unsigned int RoomSeed(unsigned int seed, int cell);
+
+private:
+	std::vector<int>			roomCells;
+	std::vector<int>			firstPoint;
+	std::vector<ContentPoint>	points;
+};
@@ -0,0 +1,59 @@
+// Entry point of the generator daemon on POSIX systems, built by the Makefile next to this file;
+// the Windows project keeps it out of the build since GeneratorService::Serve needs Unix sockets there.
+//
+//	dungeond <socket path> [cache dir] [memory cache MB]
+//
+// SIGINT and SIGTERM stop the service, it finishes the open connections before exiting.
+
+#include "GeneratorService.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argc > 4)
+	{
+		fprintf(stderr, "usage: %s <socket path> [cache dir] [memory cache MB]\n", argv[0]);
+		return 2;
+	}
+
+	const string socketPath = argv[1];
+	const string cacheDir = argc > 2 ? argv[2] : "";
+	const size_t cacheMB = argc > 3 ? strtoul(argv[3], nullptr, 10) : 256;
+
+	// block the stop signals in every thread and wait for them on a thread of their own, so Stop()
+	// runs as a normal call instead of inside a signal handler
+	sigset_t stopSignals;
+	sigemptyset(&stopSignals);
+	sigaddset(&stopSignals, SIGINT);
+	sigaddset(&stopSignals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+	GeneratorService service(cacheMB << 20, cacheDir);
+	thread waiter([&service, &stopSignals]()
+	{
+		int signal = 0;
+		sigwait(&stopSignals, &signal);
+		service.Stop();
+	});
+
+	bool ok = service.Serve(socketPath);
+	if (!ok)
+	{
+		fprintf(stderr, "%s: cannot listen on %s\n", argv[0], socketPath.c_str());
+	}
+
+	// wake the waiter when Serve returned for another reason than a signal
+	kill(getpid(), SIGTERM);
+	waiter.join();
+
+	return ok ? 0 : 1;
+}
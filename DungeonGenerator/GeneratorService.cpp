@@ -0,0 +1,395 @@
+#include "GeneratorService.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+	const char TileTable[NumTileType] = { ' ', '.', '#' };
+	const int TileDensity[NumTileType] = { 1, 0, 2 };
+	const int DefaultDensity = 1;
+	const float MeshStep = 1.0f;
+	const float MeshHeight = 2.0f;
+
+	// the walls are stored as raw LineWall records, so the tag changes with their layout
+	const char FileMagic[4] = { 'D', 'G', 'M', '2' };
+
+	// keys come from clients, so bound the work and memory a single request can ask for
+	const int MaxCellCount = 4096;
+	const int MaxRandomRadius = 2048;
+	const int MaxSideLength = 128;
+
+	bool InLimits(const GenerationKey& key)
+	{
+		return key.cellCount > 0 && key.cellCount <= MaxCellCount
+			&& key.randomRadius > 0 && key.randomRadius <= MaxRandomRadius
+			&& key.minSideLength >= 3 && key.minSideLength <= key.maxSideLength && key.maxSideLength <= MaxSideLength;
+	}
+
+	template <typename T>
+	bool WriteArray(FILE* fp, const vector<T>& data)
+	{
+		return data.empty() || fwrite(data.data(), sizeof(T), data.size(), fp) == data.size();
+	}
+
+	template <typename T>
+	bool ReadArray(FILE* fp, vector<T>& data, int count)
+	{
+		if (count < 0) return false;
+		data.resize(count);
+		return data.empty() || fread(&data[0], sizeof(T), data.size(), fp) == data.size();
+	}
+
+#ifndef _WIN32
+	bool SendAll(int fd, const void* data, size_t size)
+	{
+		const char* p = static_cast<const char*>(data);
+		while (size > 0)
+		{
+			ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool RecvAll(int fd, void* data, size_t size)
+	{
+		char* p = static_cast<char*>(data);
+		while (size > 0)
+		{
+			ssize_t n = recv(fd, p, size, 0);
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+#endif
+}
+
+size_t GenerationKeyHash::operator()(const GenerationKey& key) const
+{
+	size_t h = key.seed;
+	int fields[] = { key.cellCount, key.randomRadius, key.minSideLength, key.maxSideLength };
+	for (int i = 0; i < 4; ++i)
+	{
+		h ^= hash<int>()(fields[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	}
+	return h;
+}
+
+size_t GeneratedMap::Bytes() const
+{
+	return sizeof(GeneratedMap) + tiles.capacity() + walls.capacity() * sizeof(LineWall)
+		+ vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(int);
+}
+
+GeneratorService::GeneratorService(size_t maxBytes, const string& cacheDir)
+	: maxBytes(maxBytes), bytes(0), cacheDir(cacheDir), tempCounter(0), stopped(false), listenFd(-1)
+{
+}
+
+GeneratorService::~GeneratorService()
+{
+	Stop();
+}
+
+size_t GeneratorService::CachedBytes() const
+{
+	lock_guard<std::mutex> lock(mutex);
+	return bytes;
+}
+
+GeneratorService::MapPtr GeneratorService::Get(const GenerationKey& key)
+{
+	if (!InLimits(key)) return nullptr;
+
+	promise<MapPtr> result;
+	{
+		unique_lock<std::mutex> lock(mutex);
+
+		auto entry = entries.find(key);
+		if (entry != entries.end())
+		{
+			lru.splice(lru.begin(), lru, entry->second);
+			return entry->second->second;
+		}
+
+		auto pending = inflight.find(key);
+		if (pending != inflight.end())
+		{
+			shared_future<MapPtr> future = pending->second;
+			lock.unlock();
+			return future.get();
+		}
+
+		inflight.insert({ key, result.get_future().share() });
+	}
+
+	MapPtr map;
+	vector<pair<GenerationKey, MapPtr>> evicted;
+	try
+	{
+		map = LoadFromDisk(key);
+		if (!map)
+		{
+			map = Generate(key);
+		}
+
+		lock_guard<std::mutex> lock(mutex);
+
+		if (map)
+		{
+			lru.push_front({ key, map });
+			entries[key] = lru.begin();
+			bytes += map->Bytes();
+
+			while (bytes > maxBytes && lru.size() > 1)
+			{
+				evicted.push_back(lru.back());
+				bytes -= lru.back().second->Bytes();
+				entries.erase(lru.back().first);
+				lru.pop_back();
+			}
+		}
+
+		inflight.erase(key);
+	}
+	catch (...)
+	{
+		// the waiters get the same exception and the next request for the key starts over
+		{
+			lock_guard<std::mutex> lock(mutex);
+			inflight.erase(key);
+		}
+		result.set_exception(current_exception());
+		throw;
+	}
+
+	result.set_value(map);
+
+	for (auto e = evicted.begin(); e != evicted.end(); ++e)
+	{
+		SaveToDisk(e->first, *e->second);
+	}
+
+	return map;
+}
+
+GeneratorService::MapPtr GeneratorService::Generate(const GenerationKey& key)
+{
+	MapGenerator gen;
+	gen.SetSeed(key.seed);
+	gen.Start(key.cellCount, key.randomRadius, key.minSideLength, key.maxSideLength);
+	if (!gen.IsStarted())
+	{
+		return nullptr;
+	}
+
+	while (!gen.IsFinished())
+	{
+		gen.Update();
+	}
+	gen.GenEntryAndExit();
+
+	shared_ptr<GeneratedMap> map = make_shared<GeneratedMap>();
+	size_t width = gen.Right() - gen.Left() + 1;
+	size_t height = gen.Bottom() - gen.Top() + 1;
+	map->left = gen.Left();
+	map->top = gen.Top();
+	map->tiles.resize(width * height);
+	gen.Gen2DArrayMap(map->tiles.data(), width, height, TileTable);
+	map->width = (int)width;
+	map->height = (int)height;
+
+	MapMesh mesh;
+	mesh.CreateFromMapGenerator(gen, TileDensity, DefaultDensity);
+	mesh.GenerateMesh(MeshStep, MeshHeight);
+	map->walls = mesh.GetWalls();
+	map->vertices = mesh.GetVertices();
+	map->indices = mesh.GetIndices();
+
+	return map;
+}
+
+string GeneratorService::CachePath(const GenerationKey& key) const
+{
+	char name[128];
+	snprintf(name, sizeof(name), "/%u_%d_%d_%d_%d.map", key.seed, key.cellCount, key.randomRadius, key.minSideLength, key.maxSideLength);
+	return cacheDir + name;
+}
+
+GeneratorService::MapPtr GeneratorService::LoadFromDisk(const GenerationKey& key) const
+{
+	if (cacheDir.empty()) return nullptr;
+
+	FILE* fp = fopen(CachePath(key).c_str(), "rb");
+	if (nullptr == fp) return nullptr;
+
+	shared_ptr<GeneratedMap> map = make_shared<GeneratedMap>();
+	char magic[sizeof(FileMagic)];
+	int header[7];
+	bool ok = fread(magic, sizeof(magic), 1, fp) == 1 && equal(magic, magic + sizeof(magic), FileMagic)
+		&& fread(header, sizeof(header), 1, fp) == 1
+		&& header[2] >= 0 && header[3] >= 0
+		&& ReadArray(fp, map->tiles, header[2] * header[3])
+		&& ReadArray(fp, map->walls, header[4])
+		&& ReadArray(fp, map->vertices, header[5])
+		&& ReadArray(fp, map->indices, header[6]);
+	fclose(fp);
+
+	if (!ok) return nullptr;
+
+	map->left = header[0];
+	map->top = header[1];
+	map->width = header[2];
+	map->height = header[3];
+	return map;
+}
+
+void GeneratorService::SaveToDisk(const GenerationKey& key, const GeneratedMap& map) const
+{
+	if (cacheDir.empty()) return;
+
+	// write to a temporary name first so readers never see a partial file, the name is unique to this
+	// write so two evictions of the same key never share a file
+	string path = CachePath(key);
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%zx.%u.tmp", hash<thread::id>()(this_thread::get_id()), tempCounter++);
+	string temp = path + suffix;
+	FILE* fp = fopen(temp.c_str(), "wb");
+	if (nullptr == fp) return;
+
+	int header[] = { map.left, map.top, map.width, map.height, (int)map.walls.size(), (int)map.vertices.size(), (int)map.indices.size() };
+	bool ok = fwrite(FileMagic, sizeof(FileMagic), 1, fp) == 1 && fwrite(header, sizeof(header), 1, fp) == 1
+		&& WriteArray(fp, map.tiles) && WriteArray(fp, map.walls) && WriteArray(fp, map.vertices) && WriteArray(fp, map.indices);
+	ok = (fclose(fp) == 0) && ok;
+
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0)
+	{
+		remove(temp.c_str());
+	}
+}
+
+#ifndef _WIN32
+
+bool GeneratorService::Serve(const string& socketPath)
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(addr.sun_path)) return false;
+	socketPath.copy(addr.sun_path, socketPath.size());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return false;
+
+	unlink(socketPath.c_str());
+	if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 64) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	// publish the socket under the lock Stop() takes, so a Stop() before this point is not lost
+	{
+		lock_guard<std::mutex> lock(clientMutex);
+		if (!stopped) listenFd = fd;
+	}
+
+	while (!stopped)
+	{
+		int client = accept(fd, nullptr, nullptr);
+		if (client < 0) continue;
+
+		lock_guard<std::mutex> lock(clientMutex);
+		clients.push_back(client);
+		thread(&GeneratorService::HandleConnection, this, client).detach();
+	}
+
+	{
+		unique_lock<std::mutex> lock(clientMutex);
+		listenFd = -1;
+		for (auto c = clients.begin(); c != clients.end(); ++c)
+		{
+			shutdown(*c, SHUT_RDWR);
+		}
+		clientsDone.wait(lock, [this]() { return clients.empty(); });
+	}
+
+	close(fd);
+	unlink(socketPath.c_str());
+	return true;
+}
+
+void GeneratorService::Stop()
+{
+	lock_guard<std::mutex> lock(clientMutex);
+	stopped = true;
+	if (listenFd >= 0) shutdown(listenFd, SHUT_RDWR);
+}
+
+void GeneratorService::HandleConnection(int fd)
+{
+	int request[5];
+	while (RecvAll(fd, request, sizeof(request)))
+	{
+		GenerationKey key = { (unsigned int)request[0], request[1], request[2], request[3], request[4] };
+		MapPtr map;
+		try
+		{
+			map = Get(key);
+		}
+		catch (...)
+		{
+			// answered as a failed request, an exception must not leave this detached thread
+		}
+
+		int status = map ? 0 : 1;
+		if (!SendAll(fd, &status, sizeof(status))) break;
+		if (!map) continue;
+
+		int header[] = { map->left, map->top, map->width, map->height, (int)map->walls.size(), (int)map->vertices.size(), (int)map->indices.size() };
+		if (!SendAll(fd, header, sizeof(header))
+			|| !SendAll(fd, map->tiles.data(), map->tiles.size())
+			|| !SendAll(fd, map->walls.data(), map->walls.size() * sizeof(LineWall))
+			|| !SendAll(fd, map->vertices.data(), map->vertices.size() * sizeof(Vertex))
+			|| !SendAll(fd, map->indices.data(), map->indices.size() * sizeof(int)))
+		{
+			break;
+		}
+	}
+
+	lock_guard<std::mutex> lock(clientMutex);
+	close(fd);
+	clients.erase(find(clients.begin(), clients.end(), fd));
+	clientsDone.notify_all();
+}
+
+#else
+
+// Unix domain sockets need a newer Windows SDK than this project targets
+bool GeneratorService::Serve(const string&)
+{
+	return false;
+}
+
+void GeneratorService::Stop()
+{
+	stopped = true;
+}
+
+void GeneratorService::HandleConnection(int)
+{
+}
+
+#endif
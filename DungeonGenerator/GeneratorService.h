@@ -0,0 +1,102 @@
+#pragma once
+
+#include "MapGenerator.h"
+#include "MapMesh.h"
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct GenerationKey
+{
+	unsigned int	seed;
+	int				cellCount;
+	int				randomRadius;
+	int				minSideLength;
+	int				maxSideLength;
+
+	bool operator==(const GenerationKey& other) const
+	{
+		return seed == other.seed && cellCount == other.cellCount && randomRadius == other.randomRadius
+			&& minSideLength == other.minSideLength && maxSideLength == other.maxSideLength;
+	}
+};
+
+struct GenerationKeyHash
+{
+	size_t operator()(const GenerationKey& key) const;
+};
+
+struct GeneratedMap
+{
+	int						left;
+	int						top;
+	int						width;
+	int						height;
+	std::vector<char>		tiles;
+	std::vector<LineWall>	walls;
+	std::vector<Vertex>		vertices;
+	std::vector<int>		indices;
+
+	size_t Bytes() const;
+};
+
+// Long-running generator with an in-memory LRU of finished maps bounded by bytes, evicted maps
+// spill to files in cacheDir. Concurrent requests for the same key wait for a single generation.
+class GeneratorService
+{
+public:
+	GeneratorService(size_t maxBytes, const std::string& cacheDir);
+	~GeneratorService();
+
+	// nullptr when the parameters are outside the service's limits or rejected by MapGenerator::Start;
+	// an exception from generating the map is rethrown here and to every request waiting on the same key
+	std::shared_ptr<const GeneratedMap> Get(const GenerationKey& key);
+
+	// accepts connections on a Unix domain socket until Stop() is called, or returns at once when it already
+	// was; every request is the five GenerationKey fields as int32, answered with an int32 status followed
+	// by the map when it is 0: left, top, width, height, wall, vertex and index counts as int32, then tiles,
+	// walls, vertices, indices
+	bool Serve(const std::string& socketPath);
+	void Stop();
+
+	size_t CachedBytes() const;
+
+private:
+	typedef std::shared_ptr<const GeneratedMap> MapPtr;
+	typedef std::list<std::pair<GenerationKey, MapPtr>> LruList;
+
+	static MapPtr Generate(const GenerationKey& key);
+
+	std::string CachePath(const GenerationKey& key) const;
+	MapPtr LoadFromDisk(const GenerationKey& key) const;
+	void SaveToDisk(const GenerationKey& key, const GeneratedMap& map) const;
+
+	void HandleConnection(int fd);
+
+private:
+	size_t			maxBytes;
+	size_t			bytes;
+	std::string		cacheDir;
+
+	mutable std::atomic<unsigned int>	tempCounter;
+
+	mutable std::mutex	mutex;
+	LruList				lru;
+	std::unordered_map<GenerationKey, LruList::iterator, GenerationKeyHash>			entries;
+	std::unordered_map<GenerationKey, std::shared_future<MapPtr>, GenerationKeyHash>	inflight;
+
+	std::atomic<bool>	stopped;
+
+	// listening socket and open client connections, Serve() shuts the clients down and waits for their
+	// threads before returning
+	std::mutex				clientMutex;
+	int						listenFd;
+	std::condition_variable	clientsDone;
+	std::vector<int>		clients;
+};
@@ -1,15 +1,132 @@
 #include "MapGenerator.h"
+#include "RectUnion.h"
+#include "RoomGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
 #ifdef _DEBUG
 #include <cassert>
 #endif
 
 using namespace std;
 
+namespace
+{
+	struct DisjointSet
+	{
+		vector<int> parent;
+
+		DisjointSet(size_t count) : parent(count)
+		{
+			for (size_t i = 0; i < count; ++i) parent[i] = (int)i;
+		}
+
+		int Find(int i)
+		{
+			while (parent[i] != i)
+			{
+				parent[i] = parent[parent[i]];
+				i = parent[i];
+			}
+			return i;
+		}
+
+		void Union(int a, int b)
+		{
+			a = Find(a);
+			b = Find(b);
+			if (a < b) parent[b] = a;
+			else if (b < a) parent[a] = b;
+		}
+	};
+
+	const char CheckpointMagic[4] = { 'D', 'G', 'C', 'P' };
+	const int CheckpointVersion = 2;
+
+	template <typename T>
+	inline void Write(ostream& out, const T& value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	inline bool Read(istream& in, T& value)
+	{
+		return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+
+	// counts come from the stream, so containers only grow a bounded chunk of bytes ahead of the data
+	// actually read, and a corrupt count fails at the end of the stream instead of allocating it up front
+	const size_t ReadChunk = 1 << 16;
+
+	template <typename Container>
+	bool ReadElements(istream& in, size_t count, Container& out)
+	{
+		const size_t size = sizeof(typename Container::value_type);
+		out.clear();
+		while (out.size() < count)
+		{
+			size_t offset = out.size();
+			size_t n = min(count - offset, ReadChunk / size);
+			out.resize(offset + n);
+			if (!in.read(reinterpret_cast<char*>(&out[offset]), n * size)) return false;
+		}
+		return true;
+	}
+
+	void WriteCorridors(ostream& out, const vector<Corridor>& corridors)
+	{
+		Write(out, (unsigned int)corridors.size());
+		for (auto c = corridors.begin(); c != corridors.end(); ++c)
+		{
+			int fields[] = { c->startX, c->startY, c->endX, c->endY, c->width };
+			Write(out, fields);
+		}
+	}
+
+	bool ReadCorridors(istream& in, vector<Corridor>& corridors)
+	{
+		unsigned int count;
+		if (!Read(in, count)) return false;
+		corridors.clear();
+		corridors.reserve(min((size_t)count, ReadChunk));
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			int fields[5];
+			if (!Read(in, fields)) return false;
+			corridors.push_back({ fields[0], fields[1], fields[2], fields[3], fields[4] });
+		}
+		return true;
+	}
+
+	inline long long BucketKey(int bx, int by)
+	{
+		return (long long)(((unsigned long long)(unsigned int)by << 32) | (unsigned int)bx);
+	}
+
+	inline int FloorDiv(int a, int b)
+	{
+		return a >= 0 ? a / b : -((-a + b - 1) / b);
+	}
+
+	inline bool Intersects(int l0, int t0, int r0, int b0, int l1, int t1, int r1, int b1)
+	{
+		return l0 <= r1 && l1 <= r0 && t0 <= b1 && t1 <= b0;
+	}
+}
+
 MapGenerator::MapGenerator()
+	: left(0), top(0), right(0), bottom(0), state(Empty), entryX(0), entryY(0), exitX(0), exitY(0), expandReady(false), bucketSize(1)
 {
 }
 
 MapGenerator::MapGenerator(int seed)
+	: left(0), top(0), right(0), bottom(0), state(Empty), entryX(0), entryY(0), exitX(0), exitY(0), expandReady(false), bucketSize(1)
 {
 	generator.seed(seed);
 }
@@ -24,32 +141,52 @@ void MapGenerator::SetSeed(unsigned int seed)
 	generator.seed(seed);
 }
 
-void MapGenerator::Start(int cellCount, int randomRadius, int minSideLength, int maxSideLength)
+unsigned int MapGenerator::DeriveSeed(unsigned int seed, int index)
 {
-	if (state != Empty || cellCount <= 0 || randomRadius <= 0 || minSideLength > maxSideLength || minSideLength < 3)
+	unsigned int z = seed + 0x9e3779b9u * (unsigned int)(index + 1);
+	z = (z ^ (z >> 16)) * 0x85ebca6bu;
+	z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+	return z ^ (z >> 16);
+}
+
+void MapGenerator::Start(int cellCount, int randomRadius, int minSideLength, int maxSideLength, PlacementStrategy placement)
+{
+	// separation scatters the cells over [-randomRadius, randomRadius - maxSideLength], the other strategies
+	// grow their area to fit the cells
+	if (state != Empty || cellCount <= 0 || randomRadius <= 0 || minSideLength > maxSideLength || minSideLength < 3
+		|| placement < SeparationPlacement || placement >= NumPlacementStrategy
+		|| (placement == SeparationPlacement && 2 * (long long)randomRadius < maxSideLength))
 	{
 		return;
 	}
 
-	uniform_int_distribution<int> lengthDist(minSideLength, maxSideLength);
-	uniform_int_distribution<int> posDist(-randomRadius, randomRadius - maxSideLength);
+	switch (placement)
+	{
+	case BSPPlacement:
+		PlaceBSP(cellCount, randomRadius, minSideLength, maxSideLength);
+		break;
+	case PoissonDiskPlacement:
+		PlacePoissonDisk(cellCount, randomRadius, minSideLength, maxSideLength);
+		break;
+	case SeparationPlacement:
+	default:
+		placement = SeparationPlacement;
+		PlaceRandom(cellCount, randomRadius, minSideLength, maxSideLength);
+		break;
+	}
 
 	int thresholdLength = minSideLength + int(0.75f * (maxSideLength - minSideLength));
 
-	cells.resize(cellCount);
-	connections.resize(cellCount * cellCount);
-	for (int i = 0; i < cellCount; ++i)
+	const size_t len = cells.size();
+	connections.resize(len * len);
+	for (size_t i = 0; i < len; ++i)
 	{
-		cells[i].width = lengthDist(generator);
-		cells[i].height = lengthDist(generator);
-		cells[i].x = posDist(generator);
-		cells[i].y = posDist(generator);
 		cells[i].room = (cells[i].width * cells[i].height > thresholdLength * thresholdLength);
 	}
 
 	UpdateRect();
 
-	state = Started;
+	state = (placement == SeparationPlacement ? Started : Connecting);
 }
 
 void MapGenerator::Update()
@@ -72,23 +209,36 @@ void MapGenerator::Update()
 	}
 }
 
-void MapGenerator::GenEntryAndExit()
+bool MapGenerator::GenEntryAndExit(bool useDiameter)
 {
-	if (Finished != state) return;
+	if (Finished != state) return false;
 
 	auto last = cells.end();
 	auto first = cells.end();
 
-	for (auto i = cells.begin(); i != cells.end(); ++i)
+	if (useDiameter)
 	{
-		if (i->room)
+		RoomGraph graph;
+		graph.Build(*this);
+		if (graph.GetNodeCount() > 0)
+		{
+			first = cells.begin() + graph.GetRooms()[graph.GetDiameterFrom()];
+			last = cells.begin() + graph.GetRooms()[graph.GetDiameterTo()];
+		}
+	}
+	else
+	{
+		for (auto i = cells.begin(); i != cells.end(); ++i)
 		{
-			if (first == cells.end())
+			if (i->room)
 			{
-				first = i;
-			}
+				if (first == cells.end())
+				{
+					first = i;
+				}
 
-			last = i;
+				last = i;
+			}
 		}
 	}
 
@@ -107,54 +257,235 @@ void MapGenerator::GenEntryAndExit()
 		exitX = distX(generator);
 		exitY = distY(generator);
 	}
+
+	return first != cells.end();
 }
 
-void MapGenerator::Gen2DArrayMap(char* map, size_t& width, size_t& height, const char tileTable[NumTileType]) const
+bool MapGenerator::Validate(ValidationResult& result, bool repair)
 {
-	if (!IsFinished() || (right - left + 1 > (int)width) || (bottom - top + 1 > (int)height))
+	result.components = 0;
+	result.addedCorridors = 0;
+	result.entryToExit = false;
+	result.cellComponents.clear();
+
+	if (!IsFinished()) return false;
+
+	const size_t len = cells.size();
+
+	FindComponents(result.cellComponents);
+
+	if (repair)
 	{
-		width = height = 0;
-		return;
+		// attach every other component to the component of the first room through its closest room pair
+		size_t mainRoom = len;
+		for (size_t i = 0; i < len && mainRoom == len; ++i)
+		{
+			if (cells[i].room) mainRoom = i;
+		}
+
+		vector<bool> attached(len);
+		vector<int>& comp = result.cellComponents;
+
+		for (size_t i = 0; i < len; ++i)
+		{
+			if (!cells[i].room || mainRoom == len || comp[i] == comp[mainRoom] || attached[i]) continue;
+
+			size_t bestFrom = len, bestTo = len;
+			float bestDist = 0;
+			for (size_t a = 0; a < len; ++a)
+			{
+				if (!cells[a].room || comp[a] != comp[i]) continue;
+				for (size_t b = 0; b < len; ++b)
+				{
+					if (!cells[b].room || comp[b] != comp[mainRoom]) continue;
+					float dist = (cells[a].cx() - cells[b].cx()) * (cells[a].cx() - cells[b].cx())
+						+ (cells[a].cy() - cells[b].cy()) * (cells[a].cy() - cells[b].cy());
+					if (bestFrom == len || dist < bestDist)
+					{
+						bestFrom = a;
+						bestTo = b;
+						bestDist = dist;
+					}
+				}
+			}
+
+			for (size_t a = 0; a < len; ++a)
+			{
+				if (comp[a] == comp[i]) attached[a] = true;
+			}
+
+			ConnectCells(bestTo, bestFrom);
+			connections[bestFrom * len + bestTo] = true;
+			connections[bestTo * len + bestFrom] = true;
+			result.addedCorridors++;
+		}
+
+		if (result.addedCorridors > 0)
+		{
+			MergeCorridors();
+			UpdateRect();
+			FindComponents(result.cellComponents);
+		}
 	}
 
-	size_t w = right - left + 1;
-	size_t h = bottom - top + 1;
+	// components that hold a room, and the rooms holding entry and exit
+	vector<bool> counted(len + mergedCorridors.size());
+	int entryComp = -1, exitComp = -1;
+	for (size_t i = 0; i < len; ++i)
+	{
+		if (!cells[i].room) continue;
 
-	memset(map, tileTable[Void], width * height);
+		int comp = result.cellComponents[i];
+		if (!counted[comp])
+		{
+			counted[comp] = true;
+			result.components++;
+		}
 
-	for (auto i = cells.begin(); i != cells.end(); ++i)
+		const Cell& c = cells[i];
+		if (entryX > c.x && entryX < c.x + c.width - 1 && entryY > c.y && entryY < c.y + c.height - 1) entryComp = comp;
+		if (exitX > c.x && exitX < c.x + c.width - 1 && exitY > c.y && exitY < c.y + c.height - 1) exitComp = comp;
+	}
+
+	result.entryToExit = (entryComp >= 0 && entryComp == exitComp);
+
+	return result.components <= 1;
+}
+
+int MapGenerator::FindComponents(vector<int>& cellComponents) const
+{
+	const size_t len = cells.size();
+	const size_t count = len + mergedCorridors.size();
+
+	// element rectangles, inclusive; cells first then corridors
+	vector<int> rects(count * 4);
+	for (size_t i = 0; i < len; ++i)
 	{
-		if (i->discard) continue;
+		rects[i * 4 + 0] = cells[i].x;
+		rects[i * 4 + 1] = cells[i].y;
+		rects[i * 4 + 2] = cells[i].x + cells[i].width - 1;
+		rects[i * 4 + 3] = cells[i].y + cells[i].height - 1;
+	}
+	for (size_t i = 0; i < mergedCorridors.size(); ++i)
+	{
+		int* r = &rects[(len + i) * 4];
+		mergedCorridors[i].rect(r[0], r[1], r[2], r[3]);
+	}
 
-		size_t l = i->x - left;
-		size_t t = i->y - top;
-		size_t r = l + i->width - 1;
-		size_t b = t + i->height - 1;
+	auto isRoom = [this, len](size_t i) { return i < len && cells[i].room; };
+	auto isUsed = [this, len](size_t i) { return i >= len || !cells[i].discard; };
 
-#ifdef _DEBUG
-		assert(l >= 0 && t >= 0 && r < w && b < h);
-#endif
+	// hash every element into the buckets its rectangle (grown by one tile) covers
+	const int bucketShift = 4;
+	unordered_map<long long, vector<int>> buckets;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!isUsed(i)) continue;
+		const int* r = &rects[i * 4];
+		for (int by = (r[1] - 1) >> bucketShift; by <= (r[3] + 1) >> bucketShift; ++by)
+		{
+			for (int bx = (r[0] - 1) >> bucketShift; bx <= (r[2] + 1) >> bucketShift; ++bx)
+			{
+				buckets[BucketKey(bx, by)].push_back((int)i);
+			}
+		}
+	}
+
+	// walkable rectangles join when they overlap or share an edge, a room joins a walkable rectangle
+	// only when that reaches its interior or carves a non-corner tile of its wall
+	auto connected = [&](size_t a, size_t b)
+	{
+		if (isRoom(b)) swap(a, b);
+		const int* ra = &rects[a * 4];
+		const int* rb = &rects[b * 4];
+		if (isRoom(a))
+		{
+			return Intersects(ra[0], ra[1] + 1, ra[2], ra[3] - 1, rb[0], rb[1], rb[2], rb[3])
+				|| Intersects(ra[0] + 1, ra[1], ra[2] - 1, ra[3], rb[0], rb[1], rb[2], rb[3]);
+		}
+		return Intersects(ra[0] - 1, ra[1], ra[2] + 1, ra[3], rb[0], rb[1], rb[2], rb[3])
+			|| Intersects(ra[0], ra[1] - 1, ra[2], ra[3] + 1, rb[0], rb[1], rb[2], rb[3]);
+	};
 
-		for (size_t y = t; y <= b; ++y)
+	DisjointSet sets(count);
+	for (auto b = buckets.begin(); b != buckets.end(); ++b)
+	{
+		const vector<int>& items = b->second;
+		for (size_t i = 0; i < items.size(); ++i)
 		{
-			for (size_t x = l; x <= r; ++x)
+			for (size_t j = i + 1; j < items.size(); ++j)
 			{
-				if (i->room && (y == t || y == b || x == l || x == r))
-				{
-					map[y * width + x] = tileTable[Wall];
-				}
-				else
-				{
-					map[y * width + x] = tileTable[Walkable];
-				}
+				if (isRoom(items[i]) && isRoom(items[j])) continue;
+				if (sets.Find(items[i]) == sets.Find(items[j])) continue;
+				if (connected(items[i], items[j])) sets.Union(items[i], items[j]);
 			}
 		}
 	}
 
-	for (auto i = corridors.begin(); i != corridors.end(); ++i)
+	cellComponents.resize(len);
+	int components = 0;
+	vector<int> ids(count, -1);
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!isUsed(i)) continue;
+		int root = sets.Find((int)i);
+		if (ids[root] < 0) ids[root] = components++;
+		if (i < len) cellComponents[i] = ids[root];
+	}
+	for (size_t i = 0; i < len; ++i)
+	{
+		if (!isUsed(i)) cellComponents[i] = -1;
+	}
+
+	return components;
+}
+
+void MapGenerator::PaintRects(const FillRect& fill) const
+{
+	for (auto i = cells.begin(); i != cells.end(); ++i)
+	{
+		if (i->discard) continue;
+
+		int l = i->x;
+		int t = i->y;
+		int r = l + i->width - 1;
+		int b = t + i->height - 1;
+
+		if (i->room)
+		{
+			fill(l, t, r, b, Wall);
+			fill(l + 1, t + 1, r - 1, b - 1, Walkable);
+		}
+		else
+		{
+			fill(l, t, r, b, Walkable);
+		}
+	}
+
+	for (auto i = mergedCorridors.begin(); i != mergedCorridors.end(); ++i)
 	{
 		int l, t, r, b;
 		i->rect(l, t, r, b);
+		fill(l, t, r, b, Walkable);
+	}
+}
+
+void MapGenerator::Gen2DArrayMap(char* map, size_t& width, size_t& height, const char tileTable[NumTileType]) const
+{
+	if (!IsFinished() || (right - left + 1 > (int)width) || (bottom - top + 1 > (int)height))
+	{
+		width = height = 0;
+		return;
+	}
+
+	size_t w = right - left + 1;
+	size_t h = bottom - top + 1;
+
+	memset(map, tileTable[Void], width * height);
+
+	const size_t pitch = width;
+	PaintRects([&](int l, int t, int r, int b, TileType tile)
+	{
 		l -= left;
 		r -= left;
 		t -= top;
@@ -164,16 +495,150 @@ void MapGenerator::Gen2DArrayMap(char* map, size_t& width, size_t& height, const
 #endif
 		for (int y = t; y <= b; ++y)
 		{
-			for (int x = l; x <= r; ++x)
+			memset(map + y * pitch + l, tileTable[tile], max(r - l + 1, 0));
+		}
+	});
+
+	width = w;
+	height = h;
+
+}
+
+bool MapGenerator::Save(ostream& out) const
+{
+	out.write(CheckpointMagic, sizeof(CheckpointMagic));
+	Write(out, CheckpointVersion);
+
+	int header[] = { (int)state, left, top, right, bottom, entryX, entryY, exitX, exitY };
+	Write(out, header);
+
+	Write(out, (unsigned int)cells.size());
+	for (auto c = cells.begin(); c != cells.end(); ++c)
+	{
+		int fields[] = { c->width, c->height, c->x, c->y, c->room ? 1 : 0, c->discard ? 1 : 0 };
+		Write(out, fields);
+	}
+
+	// connections is a symmetric matrix over the cells that is empty until the rooms get connected,
+	// and only rooms are ever connected, so store its size and the list of connected room pairs
+	vector<unsigned int> rooms;
+	for (size_t i = 0; i < cells.size(); ++i)
+	{
+		if (cells[i].room) rooms.push_back((unsigned int)i);
+	}
+
+	const size_t len = cells.size();
+	vector<unsigned int> edges;
+	if (!connections.empty())
+	{
+		for (size_t a = 0; a < rooms.size(); ++a)
+		{
+			for (size_t b = a + 1; b < rooms.size(); ++b)
 			{
-				map[y * width + x] = tileTable[Walkable];
+				if (!connections[rooms[a] * len + rooms[b]]) continue;
+				edges.push_back(rooms[a]);
+				edges.push_back(rooms[b]);
 			}
 		}
 	}
+	Write(out, (unsigned long long)connections.size());
+	Write(out, (unsigned long long)edges.size() / 2);
+	out.write(reinterpret_cast<const char*>(edges.data()), edges.size() * sizeof(unsigned int));
 
-	width = w;
-	height = h;
+	WriteCorridors(out, corridors);
+	WriteCorridors(out, mergedCorridors);
+
+	ostringstream engine;
+	engine << generator;
+	string engineState = engine.str();
+	Write(out, (unsigned int)engineState.size());
+	out.write(engineState.data(), engineState.size());
 
+	return (bool)out;
+}
+
+bool MapGenerator::Load(istream& in)
+{
+	char magic[sizeof(CheckpointMagic)];
+	int version;
+	if (!in.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), CheckpointMagic)
+		|| !Read(in, version) || version != CheckpointVersion)
+	{
+		return false;
+	}
+
+	int header[9];
+	if (!Read(in, header) || header[0] < Empty || header[0] > Finished) return false;
+
+	unsigned int count;
+	if (!Read(in, count)) return false;
+	vector<Cell> newCells;
+	newCells.reserve(min((size_t)count, ReadChunk));
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		int fields[6];
+		if (!Read(in, fields)) return false;
+		newCells.push_back({ fields[0], fields[1], fields[2], fields[3], fields[4] != 0, fields[5] != 0 });
+	}
+
+	const unsigned long long len = newCells.size();
+	unsigned long long matrixSize, edgeCount;
+	if (!Read(in, matrixSize) || (matrixSize != 0 && matrixSize != len * len) || !Read(in, edgeCount)) return false;
+	if (matrixSize == 0 && edgeCount != 0) return false;
+	vector<unsigned int> edges;
+	if (edgeCount > matrixSize / 2 || !ReadElements(in, (size_t)edgeCount * 2, edges)) return false;
+	vector<bool> newConnections(matrixSize);
+	for (size_t e = 0; e < edges.size(); e += 2)
+	{
+		unsigned long long a = edges[e], b = edges[e + 1];
+		if (a >= len || b >= len) return false;
+		newConnections[a * len + b] = true;
+		newConnections[b * len + a] = true;
+	}
+
+	vector<Corridor> newCorridors, newMergedCorridors;
+	if (!ReadCorridors(in, newCorridors) || !ReadCorridors(in, newMergedCorridors)) return false;
+
+	string engineState;
+	if (!Read(in, count) || !ReadElements(in, count, engineState)) return false;
+	default_random_engine newGenerator;
+	istringstream engine(engineState);
+	engine >> newGenerator;
+	if (engine.fail()) return false;
+
+	state = (State)header[0];
+	left = header[1];
+	top = header[2];
+	right = header[3];
+	bottom = header[4];
+	entryX = header[5];
+	entryY = header[6];
+	exitX = header[7];
+	exitY = header[8];
+	cells.swap(newCells);
+	connections.swap(newConnections);
+	corridors.swap(newCorridors);
+	mergedCorridors.swap(newMergedCorridors);
+	generator = newGenerator;
+	expandReady = false;
+
+	return true;
+}
+
+void MapGenerator::Gen2DSparseMap(SparseTileMap& map, const char tileTable[NumTileType]) const
+{
+	if (!IsFinished())
+	{
+		map.Reset(0, 0, tileTable[Void]);
+		return;
+	}
+
+	map.Reset(right - left + 1, bottom - top + 1, tileTable[Void]);
+
+	PaintRects([&](int l, int t, int r, int b, TileType tile)
+	{
+		map.FillRect(l - left, t - top, r - left, b - top, tileTable[tile]);
+	});
 }
 
 void MapGenerator::UpdateRect()
@@ -202,66 +667,294 @@ void MapGenerator::UpdateRect()
 	}
 }
 
-void MapGenerator::Expand()
+void MapGenerator::PlaceRandom(int cellCount, int randomRadius, int minSideLength, int maxSideLength)
 {
-	const size_t len = cells.size();
-	vector<int> forceX(len), forceY(len);
-	int fx, fy;
+	uniform_int_distribution<int> lengthDist(minSideLength, maxSideLength);
+	uniform_int_distribution<int> posDist(-randomRadius, randomRadius - maxSideLength);
 
-	bool finished = true;
+	cells.resize(cellCount);
+	for (int i = 0; i < cellCount; ++i)
+	{
+		cells[i].width = lengthDist(generator);
+		cells[i].height = lengthDist(generator);
+		cells[i].x = posDist(generator);
+		cells[i].y = posDist(generator);
+	}
+}
+
+void MapGenerator::PlaceBSP(int cellCount, int randomRadius, int minSideLength, int maxSideLength)
+{
+	struct Region
+	{
+		int x, y, width, height;
+
+		bool operator<(const Region& other) const { return (long long)width * height < (long long)other.width * other.height; }
+	};
 
-	for (size_t a = 0; a < len; ++a)
+	// the root has to be large enough to host cellCount leaves of the maximum size
+	int side = (int)ceil(sqrt((float)cellCount)) * maxSideLength;
+	if (side < randomRadius * 2) side = randomRadius * 2;
+
+	priority_queue<Region> splittable;
+	vector<Region> leaves;
+	splittable.push({ -side / 2, -side / 2, side, side });
+
+	// always split the largest region, along its longer side
+	while (!splittable.empty() && splittable.size() + leaves.size() < (size_t)cellCount)
 	{
-		for (size_t b = a + 1; b < len; ++b)
+		Region r = splittable.top();
+		splittable.pop();
+
+		bool splitX = r.width >= r.height;
+		int len = splitX ? r.width : r.height;
+		if (len < minSideLength * 2)
 		{
-			if (!SeparatingSteering(cells[a], cells[b], fx, fy))
-			{
-				continue;
-			}
+			leaves.push_back(r);
+			continue;
+		}
 
-			finished = false;
+		uniform_int_distribution<int> splitDist(minSideLength, len - minSideLength);
+		int split = splitDist(generator);
 
-			if (fx > 0)
-			{
-				forceX[a]--;
-				forceX[b]++;
-			}
-			else if (fx < 0)
-			{
-				forceX[a]++;
-				forceX[b]--;
-			}
-			if (fy > 0)
+		if (splitX)
+		{
+			splittable.push({ r.x, r.y, split, r.height });
+			splittable.push({ r.x + split, r.y, r.width - split, r.height });
+		}
+		else
+		{
+			splittable.push({ r.x, r.y, r.width, split });
+			splittable.push({ r.x, r.y + split, r.width, r.height - split });
+		}
+	}
+
+	while (!splittable.empty())
+	{
+		leaves.push_back(splittable.top());
+		splittable.pop();
+	}
+
+	uniform_int_distribution<int> lengthDist(minSideLength, maxSideLength);
+
+	cells.resize(leaves.size());
+	for (size_t i = 0; i < leaves.size(); ++i)
+	{
+		const Region& r = leaves[i];
+		cells[i].width = min(lengthDist(generator), r.width);
+		cells[i].height = min(lengthDist(generator), r.height);
+
+		uniform_int_distribution<int> distX(r.x, r.x + r.width - cells[i].width);
+		uniform_int_distribution<int> distY(r.y, r.y + r.height - cells[i].height);
+		cells[i].x = distX(generator);
+		cells[i].y = distY(generator);
+	}
+}
+
+void MapGenerator::PlacePoissonDisk(int cellCount, int randomRadius, int minSideLength, int maxSideLength)
+{
+	// leave about half of the area empty so that rejections stay rare
+	int side = (int)ceil(sqrt(2.0f * cellCount)) * maxSideLength;
+	if (side < randomRadius * 2) side = randomRadius * 2;
+
+	// a cell is stored in the bucket of its top left corner, buckets are as large as the largest cell,
+	// so any overlapping cell is within one bucket of the candidate
+	const int bucketSize = maxSideLength;
+	const int bucketsPerSide = (side + bucketSize - 1) / bucketSize;
+	const int origin = -side / 2;
+	vector<vector<int>> buckets(bucketsPerSide * bucketsPerSide);
+
+	uniform_int_distribution<int> lengthDist(minSideLength, maxSideLength);
+
+	const int maxAttempts = cellCount * 30;
+
+	cells.clear();
+	cells.reserve(cellCount);
+	for (int attempt = 0; attempt < maxAttempts && (int)cells.size() < cellCount; ++attempt)
+	{
+		Cell c{};
+		c.width = lengthDist(generator);
+		c.height = lengthDist(generator);
+
+		uniform_int_distribution<int> distX(origin, origin + side - c.width);
+		uniform_int_distribution<int> distY(origin, origin + side - c.height);
+		c.x = distX(generator);
+		c.y = distY(generator);
+
+		int bx = (c.x - origin) / bucketSize;
+		int by = (c.y - origin) / bucketSize;
+
+		bool rejected = false;
+		for (int y = max(by - 1, 0); y <= min(by + 1, bucketsPerSide - 1) && !rejected; ++y)
+		{
+			for (int x = max(bx - 1, 0); x <= min(bx + 1, bucketsPerSide - 1) && !rejected; ++x)
 			{
-				forceY[a]--;
-				forceY[b]++;
+				const vector<int>& bucket = buckets[y * bucketsPerSide + x];
+				for (auto i = bucket.begin(); i != bucket.end(); ++i)
+				{
+					int fx, fy;
+					if (SeparatingSteering(c, cells[*i], fx, fy))
+					{
+						rejected = true;
+						break;
+					}
+				}
 			}
-			else if (fy < 0)
+		}
+
+		if (rejected) continue;
+
+		buckets[by * bucketsPerSide + bx].push_back((int)cells.size());
+		cells.push_back(c);
+	}
+}
+
+void MapGenerator::Expand()
+{
+	if (!expandReady)
+	{
+		InitExpand();
+	}
+
+	int fx, fy;
+
+	// every overlapping pair has an active cell, visit pairs of two active cells only from the lower index
+	touchedCells.clear();
+	for (auto i = activeCells.begin(); i != activeCells.end(); ++i)
+	{
+		const int a = *i;
+		const Cell& c = cells[a];
+		const int bx0 = FloorDiv(c.x - bucketSize + 1, bucketSize), bx1 = FloorDiv(c.x + c.width - 1, bucketSize);
+		const int by0 = FloorDiv(c.y - bucketSize + 1, bucketSize), by1 = FloorDiv(c.y + c.height - 1, bucketSize);
+
+		for (int by = by0; by <= by1; ++by)
+		{
+			for (int bx = bx0; bx <= bx1; ++bx)
 			{
-				forceY[a]++;
-				forceY[b]--;
+				auto bucket = buckets.find(BucketKey(bx, by));
+				if (bucket == buckets.end()) continue;
+
+				for (auto j = bucket->second.begin(); j != bucket->second.end(); ++j)
+				{
+					const int b = *j;
+					if (b == a || (b < a && overlapped[b] & 2)) continue;
+
+					const int lo = min(a, b), hi = max(a, b);
+					if (!SeparatingSteering(cells[lo], cells[hi], fx, fy))
+					{
+						continue;
+					}
+
+					for (int k : { lo, hi })
+					{
+						if (!(overlapped[k] & 1))
+						{
+							overlapped[k] |= 1;
+							touchedCells.push_back(k);
+						}
+					}
+
+					if (fx > 0)
+					{
+						forceX[lo]--;
+						forceX[hi]++;
+					}
+					else if (fx < 0)
+					{
+						forceX[lo]++;
+						forceX[hi]--;
+					}
+					if (fy > 0)
+					{
+						forceY[lo]--;
+						forceY[hi]++;
+					}
+					else if (fy < 0)
+					{
+						forceY[lo]++;
+						forceY[hi]--;
+					}
+				}
 			}
 		}
 	}
 
-	if (finished)
+	for (auto i = activeCells.begin(); i != activeCells.end(); ++i)
+	{
+		overlapped[*i] &= ~2;
+	}
+
+	if (touchedCells.empty())
 	{
 		UpdateRect();
 		state = Connecting;
+
+		expandReady = false;
+		vector<int>().swap(forceX);
+		vector<int>().swap(forceY);
+		vector<int>().swap(activeCells);
+		vector<int>().swap(touchedCells);
+		vector<char>().swap(overlapped);
+		buckets.clear();
 		return;
 	}
 
 	const static int stepLimit = 1;
 
+	// only overlapping cells get a force, and they form the next active set; the old set's buffer
+	// collects the next iteration's touched cells
+	activeCells.swap(touchedCells);
+	for (auto i = activeCells.begin(); i != activeCells.end(); ++i)
+	{
+		const int c = *i;
+		if (forceX[c] < -stepLimit) forceX[c] = -stepLimit;
+		if (forceX[c] > stepLimit) forceX[c] = stepLimit;
+		if (forceY[c] < -stepLimit) forceY[c] = -stepLimit;
+		if (forceY[c] > stepLimit) forceY[c] = stepLimit;
+
+		int oldX = cells[c].x, oldY = cells[c].y;
+		cells[c].x += forceX[c];
+		cells[c].y += forceY[c];
+		MoveToBucket(c, oldX, oldY);
+
+		forceX[c] = 0;
+		forceY[c] = 0;
+		overlapped[c] = 2;
+	}
+}
+
+void MapGenerator::InitExpand()
+{
+	const size_t len = cells.size();
+
+	bucketSize = 1;
+	for (auto c = cells.begin(); c != cells.end(); ++c)
+	{
+		bucketSize = max(bucketSize, max(c->width, c->height));
+	}
+
+	buckets.clear();
+	forceX.assign(len, 0);
+	forceY.assign(len, 0);
+	overlapped.assign(len, 2);
+	activeCells.resize(len);
 	for (size_t i = 0; i < len; ++i)
 	{
-		if (forceX[i] < -stepLimit) forceX[i] = -stepLimit;
-		if (forceX[i] > stepLimit) forceX[i] = stepLimit;
-		if (forceY[i] < -stepLimit) forceY[i] = -stepLimit;
-		if (forceY[i] > stepLimit) forceY[i] = stepLimit;
-		cells[i].x += forceX[i];
-		cells[i].y += forceY[i];
+		activeCells[i] = (int)i;
+		buckets[BucketKey(FloorDiv(cells[i].x, bucketSize), FloorDiv(cells[i].y, bucketSize))].push_back((int)i);
 	}
+
+	expandReady = true;
+}
+
+void MapGenerator::MoveToBucket(int cell, int oldX, int oldY)
+{
+	const int obx = FloorDiv(oldX, bucketSize), oby = FloorDiv(oldY, bucketSize);
+	const int nbx = FloorDiv(cells[cell].x, bucketSize), nby = FloorDiv(cells[cell].y, bucketSize);
+	if (obx == nbx && oby == nby) return;
+
+	vector<int>& from = buckets[BucketKey(obx, oby)];
+	from.erase(find(from.begin(), from.end(), cell));
+	buckets[BucketKey(nbx, nby)].push_back(cell);
 }
 
 void MapGenerator::Connect()
@@ -314,46 +1007,47 @@ void MapGenerator::Connect()
 	}
 
 	// building corridor
-	uniform_real_distribution<float> prob;
-	uniform_int_distribution<int> widthDist(1, 3);
-
-	for (auto c = cells.begin(); c != cells.end(); ++c)
-	{
-		c->discard = !c->room;
-	}
 	corridors.clear();
 
 	for (size_t i = 0; i < len; ++i)
 	{
-		int startX = (int)cells[i].cx();
-		int startY = (int)cells[i].cy();
-
 		for (size_t j = i + 1; j < len; ++j)
 		{
 			if (!connections[i * len + j]) continue;
-			int endX = (int)cells[j].cx();
-			int endY = (int)cells[j].cy();
-
-			int width = widthDist(generator);
-
-			if (prob(generator) > 0.5f)
-			{
-				AddCorridor(startX, startY, startX, endY, width);
-				AddCorridor(startX, endY, endX, endY, width);
-			}
-			else
-			{
-				AddCorridor(startX, startY, endX, startY, width);
-				AddCorridor(endX, startY, endX, endY, width);
-			}
+			ConnectCells(i, j);
 		}
 	}
 
+	MergeCorridors();
 	UpdateRect();
 
 	state = Finished;
 }
 
+void MapGenerator::ConnectCells(size_t a, size_t b)
+{
+	uniform_real_distribution<float> prob;
+	uniform_int_distribution<int> widthDist(1, 3);
+
+	int startX = (int)cells[a].cx();
+	int startY = (int)cells[a].cy();
+	int endX = (int)cells[b].cx();
+	int endY = (int)cells[b].cy();
+
+	int width = widthDist(generator);
+
+	if (prob(generator) > 0.5f)
+	{
+		AddCorridor(startX, startY, startX, endY, width);
+		AddCorridor(startX, endY, endX, endY, width);
+	}
+	else
+	{
+		AddCorridor(startX, startY, endX, startY, width);
+		AddCorridor(endX, startY, endX, endY, width);
+	}
+}
+
 void MapGenerator::AddCorridor(int startX, int startY, int endX, int endY, int width)
 {
 	if (!((startX == endX) ^ (startY == endY)) || width <= 0)
@@ -362,30 +1056,67 @@ void MapGenerator::AddCorridor(int startX, int startY, int endX, int endY, int w
 	}
 
 	corridors.push_back({ startX, startY, endX, endY, width });
+}
+
+void MapGenerator::MergeCorridors()
+{
+	vector<TileRect> rects(corridors.size());
+	for (size_t i = 0; i < corridors.size(); ++i)
+	{
+		corridors[i].rect(rects[i].left, rects[i].top, rects[i].right, rects[i].bottom);
+	}
 
-	int negHalf = width / 2;
-	int posHalf = (width - 1) / 2;
+	vector<TileRect> merged;
+	UnionRectsBestAxis(rects, merged);
 
-	for (auto c = cells.begin(); c != cells.end(); ++c)
+	// a vertical corridor as wide as the rectangle covers exactly that rectangle
+	mergedCorridors.resize(merged.size());
+	for (size_t i = 0; i < merged.size(); ++i)
 	{
-		if (!c->discard) continue;
-		if (startX == endX && startX + posHalf >= c->x && startX - negHalf < c->x + c->width)
-		{
-			if (endY < startY) swap(startY, endY);
-			if (endY < c->y || startY >= c->y + c->height)
-				continue;
-		}
-		else if (startY == endY && startY + posHalf >= c->y && startY - negHalf < c->y + c->height)
+		const TileRect& r = merged[i];
+		int width = r.right - r.left + 1;
+		mergedCorridors[i] = { r.left + width / 2, r.top, r.left + width / 2, r.bottom, width };
+	}
+
+	// cells touched by a corridor are kept as part of the map
+	const int bucketShift = 4;
+	unordered_map<long long, vector<int>> buckets;
+	for (size_t i = 0; i < merged.size(); ++i)
+	{
+		const TileRect& r = merged[i];
+		for (int by = r.top >> bucketShift; by <= r.bottom >> bucketShift; ++by)
 		{
-			if (endX < startX) swap(startX, endX);
-			if (endX < c->x || startX >= c->x + c->width)
-				continue;
+			for (int bx = r.left >> bucketShift; bx <= r.right >> bucketShift; ++bx)
+			{
+				buckets[BucketKey(bx, by)].push_back((int)i);
+			}
 		}
-		else
+	}
+
+	for (auto c = cells.begin(); c != cells.end(); ++c)
+	{
+		c->discard = !c->room;
+		if (!c->discard) continue;
+
+		const int r = c->x + c->width - 1;
+		const int b = c->y + c->height - 1;
+		for (int by = c->y >> bucketShift; by <= b >> bucketShift && c->discard; ++by)
 		{
-			continue;
+			for (int bx = c->x >> bucketShift; bx <= r >> bucketShift && c->discard; ++bx)
+			{
+				auto bucket = buckets.find(BucketKey(bx, by));
+				if (bucket == buckets.end()) continue;
+				for (auto i = bucket->second.begin(); i != bucket->second.end(); ++i)
+				{
+					const TileRect& m = merged[*i];
+					if (Intersects(m.left, m.top, m.right, m.bottom, c->x, c->y, r, b))
+					{
+						c->discard = false;
+						break;
+					}
+				}
+			}
 		}
-		c->discard = false;
 	}
 }
 
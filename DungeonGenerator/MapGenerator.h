@@ -1,6 +1,10 @@
 #pragma once
 
+#include "SparseTileMap.h"
+#include <functional>
+#include <iosfwd>
 #include <random>
+#include <unordered_map>
 #include <vector>
 
 struct Cell
@@ -53,6 +57,22 @@ enum TileType
 	NumTileType
 };
 
+struct ValidationResult
+{
+	int					components;		// connected components that contain at least one room
+	int					addedCorridors;
+	bool				entryToExit;
+	std::vector<int>	cellComponents;	// component of every cell, -1 for discarded cells
+};
+
+enum PlacementStrategy
+{
+	SeparationPlacement = 0,
+	BSPPlacement,
+	PoissonDiskPlacement,
+	NumPlacementStrategy
+};
+
 class MapGenerator
 {
 public:
@@ -62,19 +82,49 @@ public:
 
 	void SetSeed(unsigned int seed);
 
-	void Start(int cellCount, int randomRadius, int minSideLength, int maxSideLength);
+	// splitmix32 finalizer of seed and index, unrelated seeds for neighbouring indices of one parent seed
+	static unsigned int DeriveSeed(unsigned int seed, int index);
+
+	// SeparationPlacement scatters overlapping cells and lets Update() push them apart, it needs
+	// 2 * randomRadius >= maxSideLength; the other strategies place non-overlapping cells directly
+	// and go straight to Connecting
+	void Start(int cellCount, int randomRadius, int minSideLength, int maxSideLength, PlacementStrategy placement = SeparationPlacement);
 
 	void Update();
 
+	bool IsStarted() const { return state != Empty; }
+	bool IsSeparated() const { return state == Connecting || state == Finished; }
 	bool IsFinished() const { return state == Finished; }
 
-	void GenEntryAndExit();
+	// entry in the first room and exit in the last one, or with useDiameter at the two ends of the
+	// room graph's approximate diameter (see RoomGraph), the longest walk the connections allow.
+	// returns false when the map has no room, entry and exit are left unchanged then
+	bool GenEntryAndExit(bool useDiameter = false);
+
+	// checks connectivity on the cell and corridor rectangles with a union-find, without rasterizing;
+	// with repair set, rooms in other components get a corridor to the closest connected room.
+	// returns true when all rooms end up in one component
+	bool Validate(ValidationResult& result, bool repair = false);
+
+	// calls fill(left, top, right, bottom, tile) for inclusive rectangles in map coordinates, in paint
+	// order: a later rectangle overwrites the tiles of the earlier ones, tiles no rectangle covers are Void
+	typedef std::function<void(int, int, int, int, TileType)> FillRect;
+	void PaintRects(const FillRect& fill) const;
 
 	void Gen2DArrayMap(char* map, size_t& width, size_t& height, const char tileTable[NumTileType]) const;
+	// same tiles as Gen2DArrayMap, in a map that only allocates the bricks the map touches
+	void Gen2DSparseMap(SparseTileMap& map, const char tileTable[NumTileType]) const;
+
+	// complete generator state including the random engine, so Update() resumes where Save() left off;
+	// streams must be opened in binary mode, Load() leaves the generator untouched on failure
+	bool Save(std::ostream& out) const;
+	bool Load(std::istream& in);
 
 	const std::vector<Cell>& GetCells() const { return cells; }
 	const std::vector<bool>& GetConnections() const { return connections; }
 	const std::vector<Corridor>& GetCorridors() const { return corridors;  }
+	// disjoint corridor rectangles covering the same tiles as GetCorridors()
+	const std::vector<Corridor>& GetMergedCorridors() const { return mergedCorridors; }
 
 	int Left() const { return left; }
 	int Top() const { return top; }
@@ -89,9 +139,18 @@ public:
 private:
 	void UpdateRect();
 
+	void PlaceRandom(int cellCount, int randomRadius, int minSideLength, int maxSideLength);
+	void PlaceBSP(int cellCount, int randomRadius, int minSideLength, int maxSideLength);
+	void PlacePoissonDisk(int cellCount, int randomRadius, int minSideLength, int maxSideLength);
+
 	void Expand();
+	void InitExpand();
+	void MoveToBucket(int cell, int oldX, int oldY);
 	void Connect();
+	void ConnectCells(size_t a, size_t b);
 	void AddCorridor(int startX, int startY, int endX, int endY, int width);
+	void MergeCorridors();
+	int FindComponents(std::vector<int>& cellComponents) const;
 
 	static bool SeparatingSteering(const Cell& a, const Cell& b, int& fx, int& fy);
 
@@ -121,7 +180,19 @@ private:
 	std::vector<Cell>			cells;
 	std::vector<bool>			connections;
 	std::vector<Corridor>		corridors;
+	std::vector<Corridor>		mergedCorridors;
 
 	std::default_random_engine	generator;
+
+	// separation state: only cells that overlapped something in the last iteration can still overlap,
+	// candidates are found through buckets as large as the largest cell, keyed by the top left corner
+	bool									expandReady;
+	int										bucketSize;
+	std::vector<int>						forceX;
+	std::vector<int>						forceY;
+	std::vector<int>						activeCells;
+	std::vector<int>						touchedCells;
+	std::vector<char>						overlapped;
+	std::unordered_map<long long, std::vector<int>>	buckets;
 };
 
@@ -1,59 +1,235 @@
 #include "MapMesh.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <unordered_map>
 #include <functional>
-
-//#define OUTPUT_TO_FILE
-#ifdef OUTPUT_TO_FILE
-#include <cstdio>
-#endif 
+#include <thread>
 
 using namespace std;
 
-MapMesh::MapMesh()
+namespace
 {
-}
+	// inclusive rectangle painted with the density of its layer, higher layers paint over lower ones
+	struct LayerRect
+	{
+		int left, top, right, bottom;
+		int layer;
+	};
 
+	// (x, density) pairs, each density holds from x up to the next pair
+	typedef vector<pair<int, int>> RowSpans;
 
-MapMesh::~MapMesh()
-{
-}
+	// walls on the line between two rows, with the same state machine as the grid scan evaluated only
+	// where either row changes
+	template <typename AddLine>
+	void ScanRowPair(const RowSpans& last, const RowSpans& current, int y, AddLine add_line)
+	{
+		int start = -1;
+		int dir = 0;
+		int last_den_l = -1;
+		int last_den_r = -1;
 
-void MapMesh::CreateFromGridMap(const char* map, int width, int height, const char* tileTypes, int nTileTypes, int defaultDensity)
-{
-	walls.clear();
+		size_t il = 0, ir = 0;
+		while (il < last.size() || ir < current.size())
+		{
+			int x;
+			if (ir >= current.size() || (il < last.size() && last[il].first < current[ir].first))
+			{
+				x = last[il].first;
+			}
+			else
+			{
+				x = current[ir].first;
+			}
+			while (il < last.size() && last[il].first == x) ++il;
+			while (ir < current.size() && current[ir].first == x) ++ir;
+
+			int den_l = last[il - 1].second;
+			int den_r = current[ir - 1].second;
+			int den_delta = den_l - den_r;
+			if (den_delta < 0)
+			{
+				den_delta = -1;
+			}
+			else if (den_delta > 0)
+			{
+				den_delta = 1;
+			}
 
-	unordered_map<char, size_t> density;
-	typedef unordered_map<char, size_t>::iterator iter_type;
+			if (start == -1 && den_delta != 0)
+			{
+				start = x;
+				dir = den_delta;
+			}
+			else if (start != -1 && (den_l != last_den_l || den_r != last_den_r))
+			{
+				add_line(start, x, y, (dir < 0 ? last_den_r : last_den_l), (dir < 0 ? last_den_l : last_den_r), dir);
 
-	for (size_t i = 0; i < nTileTypes; ++i)
+				if (den_delta != 0)
+				{
+					start = x;
+					dir = den_delta;
+				}
+				else
+				{
+					start = -1;
+					dir = 0;
+				}
+			}
+
+			last_den_l = den_l;
+			last_den_r = den_r;
+		}
+	}
+
+	// vertical walls from the spans of every row: a wall runs down while the densities on both sides
+	// of its x stay the same, walls are reported in the order their runs end
+	template <typename AddLine>
+	void ScanColumns(const vector<RowSpans>& rows, AddLine add_line)
 	{
-		density.insert({ tileTypes[i], i });
+		struct Run
+		{
+			int x, start;
+			int den_l, den_r;
+		};
+		vector<Run> active, next;
+
+		auto end_run = [&add_line](const Run& r, int y)
+		{
+			add_line(r.start, y, r.x, max(r.den_l, r.den_r), min(r.den_l, r.den_r), r.den_l > r.den_r ? 1 : -1);
+		};
+
+		const int height = (int)rows.size();
+		for (int y = 0; y <= height; ++y)
+		{
+			// change points of row y after the leading INT_MIN span, none past the last row
+			const size_t points = y < height ? rows[y].size() : 1;
+			size_t a = 0;
+			next.clear();
+			for (size_t i = 1; i < points; ++i)
+			{
+				const int x = rows[y][i].first;
+				const int den_l = rows[y][i - 1].second;
+				const int den_r = rows[y][i].second;
+
+				for (; a < active.size() && active[a].x < x; ++a)
+				{
+					end_run(active[a], y);
+				}
+				if (a < active.size() && active[a].x == x)
+				{
+					if (active[a].den_l == den_l && active[a].den_r == den_r)
+					{
+						next.push_back(active[a++]);
+						continue;
+					}
+					end_run(active[a++], y);
+				}
+				next.push_back({ x, y, den_l, den_r });
+			}
+			for (; a < active.size(); ++a)
+			{
+				end_run(active[a], y);
+			}
+			active.swap(next);
+		}
 	}
 
-	auto density_func = [map, width, height, defaultDensity, density](int x, int y) -> size_t
+	void SweepRects(const vector<LayerRect>& rects, const int* layerDensity, int nLayers, int defaultDensity, function<void(int, int, int, int, int, int)> add_line)
 	{
-		if (((x) < 0 || (x) >= width || (y) < 0 || (y) >= height))
-			return defaultDensity;
+		vector<pair<int, int>> events;
+		events.reserve(rects.size() * 2);
+		for (size_t i = 0; i < rects.size(); ++i)
+		{
+			events.push_back({ rects[i].top, (int)i + 1 });
+			events.push_back({ rects[i].bottom + 1, -(int)i - 1 });
+		}
+		sort(events.begin(), events.end());
 
-		auto iter = density.find(map[y * width + x]);
-		if (iter != density.end())
-			return iter->second;
+		vector<int> active;
+		vector<size_t> activePos(rects.size());
+		vector<pair<int, int>> spanEvents;
+		vector<int> cover(nLayers);
 
-		return defaultDensity;
-	};
+		RowSpans last(1, { INT_MIN, defaultDensity });
+		RowSpans current;
+
+		for (size_t e = 0; e < events.size();)
+		{
+			const int y = events[e].first;
+			for (; e < events.size() && events[e].first == y; ++e)
+			{
+				int id = events[e].second;
+				if (id > 0)
+				{
+					activePos[id - 1] = active.size();
+					active.push_back(id - 1);
+				}
+				else
+				{
+					size_t pos = activePos[-id - 1];
+					active[pos] = active.back();
+					activePos[active[pos]] = pos;
+					active.pop_back();
+				}
+			}
 
-	auto func = [](int& width, int& height, function<size_t(int, int)> density_func, function<void(int, int, int, int, int)> add_line)
+			// build the spans of row y from the rectangles covering it
+			spanEvents.clear();
+			for (auto i = active.begin(); i != active.end(); ++i)
+			{
+				spanEvents.push_back({ rects[*i].left, rects[*i].layer + 1 });
+				spanEvents.push_back({ rects[*i].right + 1, -rects[*i].layer - 1 });
+			}
+			sort(spanEvents.begin(), spanEvents.end());
+
+			current.assign(1, { INT_MIN, defaultDensity });
+			for (size_t s = 0; s < spanEvents.size();)
+			{
+				const int x = spanEvents[s].first;
+				for (; s < spanEvents.size() && spanEvents[s].first == x; ++s)
+				{
+					cover[abs(spanEvents[s].second) - 1] += spanEvents[s].second > 0 ? 1 : -1;
+				}
+
+				int den = defaultDensity;
+				for (int l = nLayers - 1; l >= 0; --l)
+				{
+					if (cover[l] > 0)
+					{
+						den = layerDensity[l];
+						break;
+					}
+				}
+
+				if (den != current.back().second)
+				{
+					current.push_back({ x, den });
+				}
+			}
+
+			ScanRowPair(last, current, y, add_line);
+
+			last.swap(current);
+		}
+	}
+
+	// walls on the lines [y0, y1), each between rows y - 1 and y and running over x in [0, length]
+	template <typename DensityFunc, typename AddLine>
+	void ScanLines(int y0, int y1, int length, DensityFunc density_func, AddLine add_line)
 	{
-		for (int y = 0; y <= height; ++y)
+		for (int y = y0; y < y1; ++y)
 		{
 			int start = -1;
 			int dir = 0;
 			size_t last_den_l = -1;
 			size_t last_den_r = -1;
-
-			for (int x = 0; x <= width; ++x)
+			for (int x = 0; x <= length; ++x)
 			{
-				iter_type iter;
 				size_t den_l = density_func(x, y - 1);
 				size_t den_r = density_func(x, y);
 				int den_delta = (int)den_l - (int)den_r;
@@ -71,10 +247,9 @@ void MapMesh::CreateFromGridMap(const char* map, int width, int height, const ch
 					start = x;
 					dir = den_delta;
 				}
-				else if (start >= 0 && ((dir < 0 && (den_r != last_den_r || dir != den_delta)) || (dir > 0 && (den_l != last_den_l || dir != den_delta))))
+				else if (start >= 0 && (den_l != last_den_l || den_r != last_den_r))
 				{
-					add_line(start, x, y, (dir < 0 ? (int)den_r : (int)den_l), dir);
-
+					add_line(start, x, y, (dir < 0 ? (int)last_den_r : (int)last_den_l), (dir < 0 ? (int)last_den_l : (int)last_den_r), dir);
 					if (den_delta != 0)
 					{
 						start = x;
@@ -91,47 +266,45 @@ void MapMesh::CreateFromGridMap(const char* map, int width, int height, const ch
 				last_den_r = den_r;
 			}
 		}
-	};
-
-	func(width, height,
-		[density_func](int x, int y) { return density_func(x, y); },
-		[this](int start, int x, int y, int label, int dir) { walls.push_back({ start, y, x, y, label, dir > 0 }); });
-
-	func(height, width,
-		[density_func](int x, int y) { return density_func(y, x); },
-		[this](int start, int x, int y, int label, int dir) { walls.push_back({ y, start, y, x, label, dir < 0 }); });
-
-}
-
-void MapMesh::GenerateMesh(float stepSize, float height, float* colorList)
-{
-	vertices.clear();
-	indices.clear();
-
-	float white[] = { 1.0f, 1.0f, 1.0f };
+	}
 
-	for (auto w = walls.begin(); w != walls.end(); ++w)
+	// density of every tile character, the first occurrence of a tile type wins as it did with the map lookup
+	void DensityTable(const char* tileTypes, int nTileTypes, int defaultDensity, size_t density[256])
 	{
-		int sx = w->sx, sy = w->sy, tx = w->tx, ty = w->ty;
-		if (!w->faceRight)
+		fill(density, density + 256, (size_t)defaultDensity);
+		for (int i = nTileTypes - 1; i >= 0; --i)
 		{
-			int t = sx; sx = tx; tx = t;
-			t = sy; sy = ty; ty = t;
+			density[(unsigned char)tileTypes[i]] = i;
 		}
+	}
 
-		float* color = white;
-		if (nullptr != colorList)
+	// calls fn(begin, end, band) on bandCount contiguous slices of [0, count), each on its own thread;
+	// a band always covers the same items, so results gathered in band order do not depend on scheduling
+	template <typename Func>
+	void ForEachBand(int count, unsigned int bandCount, Func fn)
+	{
+		auto run = [&](unsigned int band)
 		{
-			color = &(colorList[w->label * 3]);
-		}
-
-		float pos[] = {
-			sx * stepSize,      0, sy * stepSize,
-			tx * stepSize,      0, ty * stepSize,
-			sx * stepSize, height, sy * stepSize,
-			tx * stepSize, height, ty * stepSize,
+			int begin = (int)((long long)count * band / bandCount);
+			int end = (int)((long long)count * (band + 1) / bandCount);
+			fn(begin, end, band);
 		};
 
+		vector<thread> workers;
+		for (unsigned int i = 1; i < bandCount; ++i)
+		{
+			workers.emplace_back(run, i);
+		}
+		run(0);
+		for (auto i = workers.begin(); i != workers.end(); ++i)
+		{
+			i->join();
+		}
+	}
+
+	// two triangles over pos, written to v[0..3] and idx[0..5] with vertex numbers from startIdx
+	void WriteQuad(const float pos[12], const float* color, Vertex* v, int* idx, int startIdx)
+	{
 		float vec1[] = { pos[3] - pos[0], pos[4] - pos[1], pos[5] - pos[2] };
 		float vec2[] = { pos[6] - pos[0], pos[7] - pos[1], pos[8] - pos[2] };
 		float dist1 = sqrt(vec1[0] * vec1[0] + vec1[1] * vec1[1] + vec1[2] * vec1[2]);
@@ -150,44 +323,576 @@ void MapMesh::GenerateMesh(float stepSize, float height, float* colorList)
 			vec1[0] * vec2[1] - vec1[1] * vec2[0],
 		};
 
-		int startIdx = (int)vertices.size();
-
 		for (size_t i = 0; i < 4; i++)
 		{
-			vertices.push_back({ pos[i * 3], pos[i * 3 + 1], pos[i * 3 + 2], normal[0], normal[1], normal[2], color[0], color[1], color[2] });
+			v[i] = { pos[i * 3], pos[i * 3 + 1], pos[i * 3 + 2], normal[0], normal[1], normal[2], color[0], color[1], color[2] };
+		}
+
+		idx[0] = startIdx + 0;
+		idx[1] = startIdx + 1;
+		idx[2] = startIdx + 2;
+		idx[3] = startIdx + 2;
+		idx[4] = startIdx + 1;
+		idx[5] = startIdx + 3;
+	}
+
+	bool WriteFile(const char* path, const void* data, size_t size)
+	{
+		FILE* fp = fopen(path, "wb");
+		if (nullptr == fp) return false;
+		bool ok = fwrite(data, 1, size, fp) == size;
+		return (fclose(fp) == 0) && ok;
+	}
+
+	void AppendUInt32(vector<char>& out, unsigned int value)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			out.push_back((char)(value >> (i * 8)));
+		}
+	}
+
+	char* FormatUInt(char* p, unsigned long long value)
+	{
+		char digits[20];
+		int n = 0;
+		do
+		{
+			digits[n++] = (char)('0' + value % 10);
+			value /= 10;
+		} while (value != 0);
+		while (n > 0)
+		{
+			*p++ = digits[--n];
+		}
+		return p;
+	}
+
+	// up to 6 decimals with the trailing zeros trimmed, falls back to printf outside the fixed point range;
+	// writes at most 18 characters
+	char* FormatFloat(char* p, float value)
+	{
+		double v = value;
+		if (!(fabs(v) < 1e9))
+		{
+			return p + snprintf(p, 18, "%g", v);
+		}
+
+		if (v == (double)(int)v)
+		{
+			if (v < 0)
+			{
+				*p++ = '-';
+			}
+			return FormatUInt(p, (unsigned long long)fabs(v));
+		}
+
+		unsigned long long fixed = (unsigned long long)(fabs(v) * 1000000.0 + 0.5);
+		if (v < 0 && fixed != 0)
+		{
+			*p++ = '-';
+		}
+		p = FormatUInt(p, fixed / 1000000);
+
+		unsigned int frac = (unsigned int)(fixed % 1000000);
+		if (frac != 0)
+		{
+			*p++ = '.';
+			int len = 6;
+			while (frac % 10 == 0)
+			{
+				frac /= 10;
+				--len;
+			}
+			for (int i = len - 1; i >= 0; --i)
+			{
+				p[i] = (char)('0' + frac % 10);
+				frac /= 10;
+			}
+			p += len;
+		}
+		return p;
+	}
+}
+
+MapMesh::MapMesh()
+{
+}
+
+
+MapMesh::~MapMesh()
+{
+}
+
+void MapMesh::CreateFromGridMap(const char* map, int width, int height, const char* tileTypes, int nTileTypes, int defaultDensity, unsigned int threadCount)
+{
+	CreateFromTiles(width, height, [map, width](int x, int y) { return map[y * width + x]; }, tileTypes, nTileTypes, defaultDensity, threadCount);
+}
+
+void MapMesh::CreateFromGridMap(const SparseTileMap& map, const char* tileTypes, int nTileTypes, int defaultDensity, unsigned int threadCount)
+{
+	walls.clear();
+
+	size_t density[256];
+	DensityTable(tileTypes, nTileTypes, defaultDensity, density);
+
+	// density spans of every row from the map's tile runs, an unallocated brick is a single run
+	const int width = map.GetWidth();
+	const int height = map.GetHeight();
+	const unsigned int bandCount = ThreadCount(threadCount, height + 1);
+	vector<RowSpans> rows(height);
+	ForEachBand(height, bandCount, [&](int begin, int end, unsigned int)
+	{
+		for (int y = begin; y < end; ++y)
+		{
+			RowSpans& spans = rows[y];
+			spans.assign(1, { INT_MIN, defaultDensity });
+			map.ForEachRowSpan(y, [&spans, &density](int start, int, char tile)
+			{
+				int den = (int)density[(unsigned char)tile];
+				if (den != spans.back().second) spans.push_back({ start, den });
+			});
+			if (spans.back().second != defaultDensity) spans.push_back({ width, defaultDensity });
 		}
+	});
 
-		indices.push_back(startIdx + 0);
-		indices.push_back(startIdx + 1);
-		indices.push_back(startIdx + 2);
-		indices.push_back(startIdx + 2);
-		indices.push_back(startIdx + 1);
-		indices.push_back(startIdx + 3);
+	// horizontal walls line by line from the spans of the rows on either side, in the order of the grid scan
+	const RowSpans outside(1, { INT_MIN, defaultDensity });
+	vector<vector<LineWall>> bands(bandCount);
+	ForEachBand(height + 1, bandCount, [&](int begin, int end, unsigned int band)
+	{
+		vector<LineWall>& out = bands[band];
+		for (int y = begin; y < end; ++y)
+		{
+			ScanRowPair(y > 0 ? rows[y - 1] : outside, y < height ? rows[y] : outside, y,
+				[&out](int start, int x, int y, int label, int lowLabel, int dir) { out.push_back({ start, y, x, y, label, lowLabel, dir > 0 }); });
+		}
+	});
+	for (auto i = bands.begin(); i != bands.end(); ++i)
+	{
+		walls.insert(walls.end(), i->begin(), i->end());
 	}
 
+	// vertical walls end in row order, the grid scan lists them column by column
+	const size_t horizontal = walls.size();
+	ScanColumns(rows, [this](int start, int end, int x, int label, int lowLabel, int dir) { walls.push_back({ x, start, x, end, label, lowLabel, dir < 0 }); });
+	sort(walls.begin() + horizontal, walls.end(), [](const LineWall& a, const LineWall& b) { return a.sx != b.sx ? a.sx < b.sx : a.sy < b.sy; });
+}
+
+template <typename TileFunc>
+void MapMesh::CreateFromTiles(int width, int height, TileFunc tile_func, const char* tileTypes, int nTileTypes, int defaultDensity, unsigned int threadCount)
+{
+	walls.clear();
+
+	size_t density[256];
+	DensityTable(tileTypes, nTileTypes, defaultDensity, density);
 
-#ifdef OUTPUT_TO_FILE
+	auto density_func = [&tile_func, &density, width, height, defaultDensity](int x, int y) -> size_t
+	{
+		if (((x) < 0 || (x) >= width || (y) < 0 || (y) >= height))
+			return defaultDensity;
+		return density[(unsigned char)tile_func(x, y)];
+	};
 
-	FILE *fp = fopen("mesh.obj", "w");
+	// horizontal lines go to the first bandCount buffers, vertical lines to the rest
+	unsigned int bandCount = ThreadCount(threadCount, max(width, height) + 1);
+	vector<vector<LineWall>> bands(bandCount * 2);
 
-	for (auto i = vertices.begin(); i != vertices.end(); ++i)
+	ForEachBand(height + 1, bandCount, [&](int begin, int end, unsigned int band)
 	{
-		fprintf(fp, "v %f %f %f\n", i->x, i->y, i->z);
+		vector<LineWall>& out = bands[band];
+		ScanLines(begin, end, width,
+			[&density_func](int x, int y) { return density_func(x, y); },
+			[&out](int start, int x, int y, int label, int lowLabel, int dir) { out.push_back({ start, y, x, y, label, lowLabel, dir > 0 }); });
+	});
+	ForEachBand(width + 1, bandCount, [&](int begin, int end, unsigned int band)
+	{
+		vector<LineWall>& out = bands[bandCount + band];
+		ScanLines(begin, end, height,
+			[&density_func](int x, int y) { return density_func(y, x); },
+			[&out](int start, int x, int y, int label, int lowLabel, int dir) { out.push_back({ y, start, y, x, label, lowLabel, dir < 0 }); });
+	});
+
+	size_t total = 0;
+	for (auto i = bands.begin(); i != bands.end(); ++i)
+	{
+		total += i->size();
 	}
+	walls.reserve(total);
+	for (auto i = bands.begin(); i != bands.end(); ++i)
+	{
+		walls.insert(walls.end(), i->begin(), i->end());
+	}
+}
+
+void MapMesh::CreateFromMapGenerator(const MapGenerator& gen, const int tileDensity[NumTileType], int defaultDensity)
+{
+	walls.clear();
+
+	if (!gen.IsFinished()) return;
+
+	// layers in painting order of Gen2DArrayMap
+	enum { BoundsLayer, RoomWallLayer, CellLayer, CorridorLayer, NumLayer };
+	const int layerDensity[NumLayer] = { tileDensity[Void], tileDensity[Wall], tileDensity[Walkable], tileDensity[Walkable] };
 
-	for (auto i = vertices.begin(); i != vertices.end(); ++i)
+	const int ox = gen.Left();
+	const int oy = gen.Top();
+
+	vector<LayerRect> rects;
+	rects.push_back({ 0, 0, gen.Right() - ox, gen.Bottom() - oy, BoundsLayer });
+
+	const vector<Cell>& cells = gen.GetCells();
+	for (auto c = cells.begin(); c != cells.end(); ++c)
 	{
-		fprintf(fp, "vn %f %f %f\n", i->nx, i->ny, i->nz);
+		if (c->discard) continue;
+
+		int l = c->x - ox;
+		int t = c->y - oy;
+		int r = l + c->width - 1;
+		int b = t + c->height - 1;
+
+		if (!c->room)
+		{
+			rects.push_back({ l, t, r, b, CellLayer });
+			continue;
+		}
+
+		rects.push_back({ l, t, r, t, RoomWallLayer });
+		rects.push_back({ l, b, r, b, RoomWallLayer });
+		if (b - t >= 2)
+		{
+			rects.push_back({ l, t + 1, l, b - 1, RoomWallLayer });
+			rects.push_back({ r, t + 1, r, b - 1, RoomWallLayer });
+			if (r - l >= 2)
+			{
+				rects.push_back({ l + 1, t + 1, r - 1, b - 1, CellLayer });
+			}
+		}
 	}
 
-	for (size_t i = 0; i < indices.size(); i += 3)
+	const vector<Corridor>& corridors = gen.GetMergedCorridors();
+	for (auto i = corridors.begin(); i != corridors.end(); ++i)
 	{
-		fprintf(fp, "f %d %d %d\n", indices[i] + 1, indices[i + 1] + 1, indices[i + 2] + 1);
+		LayerRect r;
+		i->rect(r.left, r.top, r.right, r.bottom);
+		r.left -= ox;
+		r.right -= ox;
+		r.top -= oy;
+		r.bottom -= oy;
+		r.layer = CorridorLayer;
+		rects.push_back(r);
 	}
 
-	fclose(fp);
+	SweepRects(rects, layerDensity, NumLayer, defaultDensity,
+		[this](int start, int x, int y, int label, int lowLabel, int dir) { walls.push_back({ start, y, x, y, label, lowLabel, dir > 0 }); });
 
-#endif
+	for (auto r = rects.begin(); r != rects.end(); ++r)
+	{
+		swap(r->left, r->top);
+		swap(r->right, r->bottom);
+	}
 
+	SweepRects(rects, layerDensity, NumLayer, defaultDensity,
+		[this](int start, int x, int y, int label, int lowLabel, int dir) { walls.push_back({ y, start, y, x, label, lowLabel, dir < 0 }); });
 }
 
+void MapMesh::GenerateMesh(float stepSize, float height, float* colorList, unsigned int threadCount)
+{
+	// every wall is one quad, so wall i owns vertices [4i, 4i + 4) and indices [6i, 6i + 6)
+	// and the bands fill the presized buffers without coordinating
+	vertices.resize(walls.size() * 4);
+	indices.resize(walls.size() * 6);
+
+	float white[] = { 1.0f, 1.0f, 1.0f };
+
+	ForEachBand((int)walls.size(), ThreadCount(threadCount, (int)walls.size()), [&](int begin, int end, unsigned int)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const LineWall* w = &walls[i];
+			int sx = w->sx, sy = w->sy, tx = w->tx, ty = w->ty;
+			if (!w->faceRight)
+			{
+				int t = sx; sx = tx; tx = t;
+				t = sy; sy = ty; ty = t;
+			}
+
+			float* color = white;
+			if (nullptr != colorList)
+			{
+				color = &(colorList[w->label * 3]);
+			}
+
+			float pos[] = {
+				sx * stepSize,      0, sy * stepSize,
+				tx * stepSize,      0, ty * stepSize,
+				sx * stepSize, height, sy * stepSize,
+				tx * stepSize, height, ty * stepSize,
+			};
+
+			WriteQuad(pos, color, &vertices[i * 4], &indices[i * 6], i * 4);
+		}
+	});
+}
+
+void MapMesh::GenerateFloorMesh(const char* map, int width, int height, const char* tileTypes, int nTileTypes, int floorLabels, float stepSize, float ceilingHeight, float* colorList)
+{
+	unordered_map<char, int> density;
+	for (int i = 0; i < nTileTypes && i < floorLabels; ++i)
+	{
+		density.insert({ tileTypes[i], i });
+	}
+
+	// density of every floor tile, -1 for the rest and for tiles already merged
+	vector<int> labels(width * height);
+	for (int i = 0; i < width * height; ++i)
+	{
+		auto iter = density.find(map[i]);
+		labels[i] = iter != density.end() ? iter->second : -1;
+	}
+
+	float white[] = { 1.0f, 1.0f, 1.0f };
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			int label = labels[y * width + x];
+			if (label < 0) continue;
+
+			// grow right as far as the label holds, then down while whole rows match
+			int right = x + 1;
+			while (right < width && labels[y * width + right] == label) ++right;
+
+			int bottom = y + 1;
+			for (; bottom < height; ++bottom)
+			{
+				int i = x;
+				while (i < right && labels[bottom * width + i] == label) ++i;
+				if (i < right) break;
+			}
+
+			for (int j = y; j < bottom; ++j)
+			{
+				fill(labels.begin() + j * width + x, labels.begin() + j * width + right, -1);
+			}
+
+			float* color = white;
+			if (nullptr != colorList)
+			{
+				color = &(colorList[label * 3]);
+			}
+
+			float x0 = x * stepSize, z0 = y * stepSize, x1 = right * stepSize, z1 = bottom * stepSize;
+
+			float floor[] = {
+				x0, 0, z0,
+				x0, 0, z1,
+				x1, 0, z0,
+				x1, 0, z1,
+			};
+			AddQuad(floor, color);
+
+			float ceiling[] = {
+				x0, ceilingHeight, z0,
+				x1, ceilingHeight, z0,
+				x0, ceilingHeight, z1,
+				x1, ceilingHeight, z1,
+			};
+			AddQuad(ceiling, color);
+		}
+	}
+}
+
+void MapMesh::AddQuad(const float pos[12], const float* color)
+{
+	size_t v = vertices.size();
+	size_t i = indices.size();
+	vertices.resize(v + 4);
+	indices.resize(i + 6);
+	WriteQuad(pos, color, &vertices[v], &indices[i], (int)v);
+}
+
+bool MapMesh::WriteGLB(const char* path) const
+{
+	static_assert(sizeof(Vertex) == 9 * sizeof(float), "Vertex is written to the buffer as is");
+
+	if (vertices.empty() || indices.empty()) return false;
+
+	const size_t vertexBytes = vertices.size() * sizeof(Vertex);
+	const size_t indexBytes = indices.size() * sizeof(unsigned int);
+
+	float minPos[3] = { vertices[0].x, vertices[0].y, vertices[0].z };
+	float maxPos[3] = { vertices[0].x, vertices[0].y, vertices[0].z };
+	for (auto v = vertices.begin(); v != vertices.end(); ++v)
+	{
+		minPos[0] = min(minPos[0], v->x);
+		minPos[1] = min(minPos[1], v->y);
+		minPos[2] = min(minPos[2], v->z);
+		maxPos[0] = max(maxPos[0], v->x);
+		maxPos[1] = max(maxPos[1], v->y);
+		maxPos[2] = max(maxPos[2], v->z);
+	}
+
+	// one interleaved view for the vertices (position, normal, color at 0, 12 and 24) and one for the indices
+	char json[2048];
+	int jsonLen = snprintf(json, sizeof(json),
+		"{\"asset\":{\"version\":\"2.0\",\"generator\":\"DungeonGenerator\"},"
+		"\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+		"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"COLOR_0\":2},\"indices\":3,\"mode\":4}]}],"
+		"\"buffers\":[{\"byteLength\":%zu}],"
+		"\"bufferViews\":["
+		"{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%zu,\"byteStride\":%zu,\"target\":34962},"
+		"{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34963}],"
+		"\"accessors\":["
+		"{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+		"{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"},"
+		"{\"bufferView\":0,\"byteOffset\":24,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"},"
+		"{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":%zu,\"type\":\"SCALAR\"}]}",
+		vertexBytes + indexBytes,
+		vertexBytes, sizeof(Vertex),
+		vertexBytes, indexBytes,
+		vertices.size(), minPos[0], minPos[1], minPos[2], maxPos[0], maxPos[1], maxPos[2],
+		vertices.size(),
+		vertices.size(),
+		indices.size());
+	if (jsonLen < 0 || jsonLen >= (int)sizeof(json)) return false;
+
+	// chunks are 4 byte aligned, json padded with spaces and the binary chunk with zeros
+	const size_t jsonChunk = (jsonLen + 3) & ~(size_t)3;
+	const size_t binChunk = (vertexBytes + indexBytes + 3) & ~(size_t)3;
+	const size_t total = 12 + 8 + jsonChunk + 8 + binChunk;
+	if (total > 0xffffffffu) return false;
+
+	vector<char> out;
+	out.reserve(total);
+	AppendUInt32(out, 0x46546C67);	// "glTF"
+	AppendUInt32(out, 2);
+	AppendUInt32(out, (unsigned int)total);
+
+	AppendUInt32(out, (unsigned int)jsonChunk);
+	AppendUInt32(out, 0x4E4F534A);	// "JSON"
+	out.insert(out.end(), json, json + jsonLen);
+	out.resize(out.size() + jsonChunk - jsonLen, ' ');
+
+	AppendUInt32(out, (unsigned int)binChunk);
+	AppendUInt32(out, 0x004E4942);	// "BIN"
+	const char* vertexData = (const char*)vertices.data();
+	const char* indexData = (const char*)indices.data();
+	out.insert(out.end(), vertexData, vertexData + vertexBytes);
+	out.insert(out.end(), indexData, indexData + indexBytes);
+	out.resize(total, 0);
+
+	return WriteFile(path, out.data(), out.size());
+}
+
+bool MapMesh::WriteOBJ(const char* path, unsigned int threadCount) const
+{
+	// worst case line lengths: "v" with six floats, "vn" with three, "f" with three a//a pairs
+	const size_t vertexLine = 2 + 6 * 19;
+	const size_t normalLine = 3 + 3 * 19;
+	const size_t faceLine = 2 + 3 * 23;
+
+	const int vertexCount = (int)vertices.size();
+	const int faceCount = (int)(indices.size() / 3);
+
+	// the "v", "vn" and "f" sections are each formatted in bands and written out in band order
+	unsigned int bandCount = ThreadCount(threadCount, max(vertexCount, faceCount));
+	vector<vector<char>> bands(bandCount * 3);
+
+	// quads share their normal and color, so a run is formatted once and copied while it repeats
+	struct RunCache
+	{
+		char text[3 * 19];
+		size_t length;
+		float values[3];
+
+		char* Append(char* p, const float v[3])
+		{
+			if (length == 0 || memcmp(v, values, sizeof(values)) != 0)
+			{
+				char* c = text;
+				for (int i = 0; i < 3; ++i)
+				{
+					*c++ = ' ';
+					c = FormatFloat(c, v[i]);
+				}
+				length = c - text;
+				memcpy(values, v, sizeof(values));
+			}
+			memcpy(p, text, length);
+			return p + length;
+		}
+	};
+
+	ForEachBand(vertexCount, bandCount, [&](int begin, int end, unsigned int band)
+	{
+		vector<char>& out = bands[band];
+		out.resize((end - begin) * vertexLine);
+		char* p = out.data();
+		RunCache colors = {};
+		for (int i = begin; i < end; ++i)
+		{
+			const Vertex& v = vertices[i];
+			const float position[] = { v.x, v.y, v.z };
+			const float color[] = { v.r, v.g, v.b };
+			*p++ = 'v';
+			for (int j = 0; j < 3; ++j)
+			{
+				*p++ = ' ';
+				p = FormatFloat(p, position[j]);
+			}
+			p = colors.Append(p, color);
+			*p++ = '\n';
+		}
+		out.resize(p - out.data());
+	});
+
+	ForEachBand(vertexCount, bandCount, [&](int begin, int end, unsigned int band)
+	{
+		vector<char>& out = bands[bandCount + band];
+		out.resize((end - begin) * normalLine);
+		char* p = out.data();
+		RunCache normals = {};
+		for (int i = begin; i < end; ++i)
+		{
+			const Vertex& v = vertices[i];
+			const float normal[] = { v.nx, v.ny, v.nz };
+			*p++ = 'v';
+			*p++ = 'n';
+			p = normals.Append(p, normal);
+			*p++ = '\n';
+		}
+		out.resize(p - out.data());
+	});
+
+	ForEachBand(faceCount, bandCount, [&](int begin, int end, unsigned int band)
+	{
+		vector<char>& out = bands[bandCount * 2 + band];
+		out.resize((end - begin) * faceLine);
+		char* p = out.data();
+		for (int i = begin * 3; i < end * 3; i += 3)
+		{
+			*p++ = 'f';
+			for (int j = i; j < i + 3; ++j)
+			{
+				*p++ = ' ';
+				p = FormatUInt(p, (unsigned long long)indices[j] + 1);
+				*p++ = '/';
+				*p++ = '/';
+				p = FormatUInt(p, (unsigned long long)indices[j] + 1);
+			}
+			*p++ = '\n';
+		}
+		out.resize(p - out.data());
+	});
+
+	FILE* fp = fopen(path, "wb");
+	if (nullptr == fp) return false;
+	bool ok = true;
+	for (auto i = bands.begin(); ok && i != bands.end(); ++i)
+	{
+		ok = fwrite(i->data(), 1, i->size(), fp) == i->size();
+	}
+	return (fclose(fp) == 0) && ok;
+}
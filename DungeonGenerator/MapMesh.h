@@ -1,5 +1,7 @@
 #pragma once
 
+#include "MapGenerator.h"
+#include "SparseTileMap.h"
 #include <vector>
 
 struct Vertex
@@ -12,7 +14,8 @@ struct Vertex
 struct LineWall
 {
 	int sx, sy, tx, ty;
-	int label;
+	int label;		// density of the denser side
+	int lowLabel;	// density of the other side
 	bool faceRight;
 };
 
@@ -22,13 +25,37 @@ public:
 	MapMesh();
 	~MapMesh();
 
-	void CreateFromGridMap(const char* map, int width, int height, const char* tileTypes, int nTileTypes, int defaultDensity);
-	void GenerateMesh(float stepSize, float height, float* colorList = nullptr);
+	// threadCount splits the rows and columns into bands extracted in parallel (0 uses all cores);
+	// the walls come out in the same order whatever the number of threads. The SparseTileMap overload
+	// works from the map's row spans, so an unallocated brick costs one span per row instead of its tiles
+	void CreateFromGridMap(const char* map, int width, int height, const char* tileTypes, int nTileTypes, int defaultDensity, unsigned int threadCount = 1);
+	void CreateFromGridMap(const SparseTileMap& map, const char* tileTypes, int nTileTypes, int defaultDensity, unsigned int threadCount = 1);
+
+	// same walls as CreateFromGridMap on the output of MapGenerator::Gen2DArrayMap, computed with a sweep
+	// over the cell and corridor rectangles instead of the grid; tileDensity gives the density of each TileType
+	void CreateFromMapGenerator(const MapGenerator& gen, const int tileDensity[NumTileType], int defaultDensity);
+
+	void GenerateMesh(float stepSize, float height, float* colorList = nullptr, unsigned int threadCount = 1);
+
+	// floor and ceiling quads for the tiles of the first floorLabels tile types, merged into maximal
+	// rectangles per type; appended to the wall geometry, so call it after GenerateMesh
+	void GenerateFloorMesh(const char* map, int width, int height, const char* tileTypes, int nTileTypes, int floorLabels, float stepSize, float ceilingHeight, float* colorList = nullptr);
 
 	const std::vector<LineWall>& GetWalls() const { return walls; }
 	const std::vector<Vertex>& GetVertices() const { return vertices; }
 	const std::vector<int>& GetIndices() const { return indices; }
+
+	// binary glTF 2.0 with interleaved POSITION, NORMAL and COLOR_0 and 32 bit indices; false when
+	// there is no geometry yet or the file can't be written
+	bool WriteGLB(const char* path) const;
+	// Wavefront OBJ with the colors appended to the "v" lines, formatted on threadCount threads (0 uses all cores)
+	bool WriteOBJ(const char* path, unsigned int threadCount = 1) const;
 	
+private:
+	void AddQuad(const float pos[12], const float* color);
+	template <typename TileFunc>
+	void CreateFromTiles(int width, int height, TileFunc tile_func, const char* tileTypes, int nTileTypes, int defaultDensity, unsigned int threadCount);
+
 private:
 	std::vector<LineWall>	walls;
 	std::vector<Vertex>		vertices;
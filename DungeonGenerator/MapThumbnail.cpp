@@ -0,0 +1,274 @@
+#include "MapThumbnail.h"
+#include "RectUnion.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+namespace
+{
+	const float VoidColor[] = { 1.0f, 1.0f, 1.0f };
+	const float WalkableColor[] = { 200 / 255.0f, 200 / 255.0f, 1.0f };
+	const float WallColor[] = { 1.0f, 200 / 255.0f, 200 / 255.0f };
+	const float LineColor[] = { 0.4f, 0.4f, 0.4f };
+	const float EntryColor[] = { 0.0f, 1.0f, 1.0f };
+	const float ExitColor[] = { 0.0f, 0.0f, 1.0f };
+
+	unsigned int Crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+	{
+		static const array<unsigned int, 256> table = []()
+		{
+			array<unsigned int, 256> t;
+			for (unsigned int i = 0; i < 256; ++i)
+			{
+				unsigned int c = i;
+				for (int k = 0; k < 8; ++k)
+				{
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				}
+				t[i] = c;
+			}
+			return t;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+		{
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	void PutU32(vector<unsigned char>& out, unsigned int v)
+	{
+		out.push_back((unsigned char)(v >> 24));
+		out.push_back((unsigned char)(v >> 16));
+		out.push_back((unsigned char)(v >> 8));
+		out.push_back((unsigned char)v);
+	}
+
+	void PutChunk(vector<unsigned char>& out, const char type[4], const vector<unsigned char>& data)
+	{
+		PutU32(out, (unsigned int)data.size());
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		PutU32(out, Crc32(&out[start], out.size() - start));
+	}
+
+	bool WriteFile(const char* path, const vector<unsigned char>& data)
+	{
+		FILE* fp = fopen(path, "wb");
+		if (nullptr == fp) return false;
+		bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+		return (fclose(fp) == 0) && ok;
+	}
+}
+
+MapThumbnail::MapThumbnail()
+	: width(0), height(0), scale(1), offsetX(0), offsetY(0)
+{
+}
+
+MapThumbnail::~MapThumbnail()
+{
+}
+
+void MapThumbnail::Render(const MapGenerator& gen, const vector<LineWall>* walls, int width, int height)
+{
+	this->width = max(width, 0);
+	this->height = max(height, 0);
+
+	color.resize(this->width * this->height * 3);
+	for (size_t i = 0; i < color.size(); i += 3)
+	{
+		color[i + 0] = VoidColor[0];
+		color[i + 1] = VoidColor[1];
+		color[i + 2] = VoidColor[2];
+	}
+
+	if (gen.IsStarted() && this->width > 0 && this->height > 0)
+	{
+		const int mapW = gen.Right() - gen.Left() + 1;
+		const int mapH = gen.Bottom() - gen.Top() + 1;
+		scale = min(this->width / (float)mapW, this->height / (float)mapH);
+		offsetX = (this->width - mapW * scale) * 0.5f - gen.Left() * scale;
+		offsetY = (this->height - mapH * scale) * 0.5f - gen.Top() * scale;
+
+		// every pixel is the area-weighted average of the tiles under it: the painted rectangles are
+		// flattened into disjoint walkable and wall rectangles, so their coverage adds up exactly
+		vector<TileRect> rects, tileRects;
+		vector<int> tiles, rectTiles;
+		gen.PaintRects([&](int l, int t, int r, int b, TileType tile)
+		{
+			rects.push_back({ max(l, gen.Left()), max(t, gen.Top()), min(r, gen.Right()), min(b, gen.Bottom()) });
+			tiles.push_back(tile);
+		});
+		FlattenRects(rects, tiles, tileRects, rectTiles);
+
+		coverage.assign(this->width * this->height, 0.0f);
+		for (int tile : { Walkable, Wall })
+		{
+			for (size_t i = 0; i < tileRects.size(); ++i)
+			{
+				if (rectTiles[i] != tile) continue;
+				const TileRect& r = tileRects[i];
+				CoverRect((float)r.left, (float)r.top, r.right + 1.0f, r.bottom + 1.0f);
+			}
+			AddLayer(tile == Walkable ? WalkableColor : WallColor);
+		}
+
+		// walls are drawn one output pixel thick
+		if (nullptr != walls)
+		{
+			const float half = 0.5f / scale;
+			for (auto w = walls->begin(); w != walls->end(); ++w)
+			{
+				float sx = (float)(min(w->sx, w->tx) + gen.Left());
+				float sy = (float)(min(w->sy, w->ty) + gen.Top());
+				float tx = (float)(max(w->sx, w->tx) + gen.Left());
+				float ty = (float)(max(w->sy, w->ty) + gen.Top());
+				CoverRect(sx - half, sy - half, tx + half, ty + half);
+			}
+			ResolveLayer(LineColor);
+		}
+
+		if (gen.IsFinished())
+		{
+			const float size = max(1.0f, 1.0f / scale);
+			float ex = gen.EntryX() + 0.5f, ey = gen.EntryY() + 0.5f;
+			float xx = gen.ExitX() + 0.5f, xy = gen.ExitY() + 0.5f;
+			CoverRect(ex - size * 0.5f, ey - size * 0.5f, ex + size * 0.5f, ey + size * 0.5f);
+			ResolveLayer(EntryColor);
+			CoverRect(xx - size * 0.5f, xy - size * 0.5f, xx + size * 0.5f, xy + size * 0.5f);
+			ResolveLayer(ExitColor);
+		}
+	}
+
+	pixels.resize(color.size());
+	for (size_t i = 0; i < color.size(); ++i)
+	{
+		pixels[i] = (unsigned char)(min(max(color[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+}
+
+void MapThumbnail::CoverRect(float left, float top, float right, float bottom)
+{
+	// to pixel space, then add the fraction of every touched pixel's area that is covered
+	float x0 = max(left * scale + offsetX, 0.0f);
+	float y0 = max(top * scale + offsetY, 0.0f);
+	float x1 = min(right * scale + offsetX, (float)width);
+	float y1 = min(bottom * scale + offsetY, (float)height);
+	if (x0 >= x1 || y0 >= y1) return;
+
+	const int ix0 = (int)x0, ix1 = min((int)ceil(x1), width);
+	const int iy0 = (int)y0, iy1 = min((int)ceil(y1), height);
+
+	for (int y = iy0; y < iy1; ++y)
+	{
+		float cy = min(y1, y + 1.0f) - max(y0, (float)y);
+		float* row = &coverage[y * width];
+		for (int x = ix0; x < ix1; ++x)
+		{
+			row[x] += cy * (min(x1, x + 1.0f) - max(x0, (float)x));
+		}
+	}
+}
+
+void MapThumbnail::ResolveLayer(const float c[3])
+{
+	// the rectangles of a layer share its color, so their coverage adds up to at most the whole pixel
+	// and the layer blends over what is below it once
+	for (size_t i = 0; i < coverage.size(); ++i)
+	{
+		float a = min(coverage[i], 1.0f);
+		if (a <= 0) continue;
+		float* p = &color[i * 3];
+		p[0] += (c[0] - p[0]) * a;
+		p[1] += (c[1] - p[1]) * a;
+		p[2] += (c[2] - p[2]) * a;
+		coverage[i] = 0;
+	}
+}
+
+void MapThumbnail::AddLayer(const float c[3])
+{
+	// the layer only covers void, so the covered part of every pixel trades the void color for its own
+	for (size_t i = 0; i < coverage.size(); ++i)
+	{
+		float a = min(coverage[i], 1.0f);
+		if (a <= 0) continue;
+		float* p = &color[i * 3];
+		p[0] += (c[0] - VoidColor[0]) * a;
+		p[1] += (c[1] - VoidColor[1]) * a;
+		p[2] += (c[2] - VoidColor[2]) * a;
+		coverage[i] = 0;
+	}
+}
+
+bool MapThumbnail::WritePPM(const char* path) const
+{
+	char header[64];
+	int len = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+	vector<unsigned char> data(header, header + len);
+	data.insert(data.end(), pixels.begin(), pixels.end());
+	return WriteFile(path, data);
+}
+
+bool MapThumbnail::WritePNG(const char* path) const
+{
+	// zlib stream of stored deflate blocks, every row prefixed with filter type 0
+	const size_t rowBytes = (size_t)width * 3 + 1;
+	vector<unsigned char> raw(rowBytes * height);
+	for (int y = 0; y < height; ++y)
+	{
+		raw[y * rowBytes] = 0;
+		copy(pixels.begin() + y * (rowBytes - 1), pixels.begin() + (y + 1) * (rowBytes - 1), raw.begin() + y * rowBytes + 1);
+	}
+
+	vector<unsigned char> idat;
+	idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	size_t pos = 0;
+	do
+	{
+		size_t block = min(raw.size() - pos, (size_t)65535);
+		bool last = pos + block == raw.size();
+		idat.push_back(last ? 1 : 0);
+		idat.push_back((unsigned char)block);
+		idat.push_back((unsigned char)(block >> 8));
+		idat.push_back((unsigned char)~block);
+		idat.push_back((unsigned char)(~block >> 8));
+		idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + block);
+		pos += block;
+	} while (pos < raw.size());
+
+	unsigned int a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); ++i)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	PutU32(idat, (b << 16) | a);
+
+	vector<unsigned char> ihdr;
+	PutU32(ihdr, width);
+	PutU32(ihdr, height);
+	ihdr.push_back(8);		// bit depth
+	ihdr.push_back(2);		// RGB
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+
+	const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	vector<unsigned char> png(signature, signature + sizeof(signature));
+	PutChunk(png, "IHDR", ihdr);
+	PutChunk(png, "IDAT", idat);
+	PutChunk(png, "IEND", vector<unsigned char>());
+
+	return WriteFile(path, png);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "MapGenerator.h"
+#include "MapMesh.h"
+#include <vector>
+
+// Software rasterizer for map previews in the colors of the grid view: the tiles are box-filtered down
+// to the output size, walls and markers are drawn over them with area-averaged coverage.
+class MapThumbnail
+{
+public:
+	MapThumbnail();
+	~MapThumbnail();
+
+	// fits the map into width x height pixels, keeping its aspect ratio; walls are optional and in the
+	// grid coordinates produced by MapMesh, i.e. relative to the map's left and top
+	void Render(const MapGenerator& gen, const std::vector<LineWall>* walls, int width, int height);
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+
+	// 8 bit RGB, rows top to bottom
+	const std::vector<unsigned char>& GetPixels() const { return pixels; }
+
+	bool WritePPM(const char* path) const;
+	bool WritePNG(const char* path) const;
+
+private:
+	// layers in painting order: cover the rectangles of a layer, then resolve it in its color.
+	// AddLayer is for the tile layers, which are disjoint and only cover void, ResolveLayer blends
+	// the overlays over whatever is below them
+	void CoverRect(float left, float top, float right, float bottom);
+	void AddLayer(const float color[3]);
+	void ResolveLayer(const float color[3]);
+
+private:
+	int							width;
+	int							height;
+	float						scale;
+	float						offsetX;
+	float						offsetY;
+	std::vector<float>			color;
+	std::vector<float>			coverage;
+	std::vector<unsigned char>	pixels;
+};
@@ -0,0 +1,217 @@
+#include "MapVisibility.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+namespace
+{
+	// a box in tile corner coordinates
+	struct Box
+	{
+		double left, top, right, bottom;
+	};
+
+	// the four frames map every line to one with a slope in [0, 1]: as is, mirrored in y, with x and y
+	// swapped, and swapped then mirrored
+	const int NumFrames = 4;
+
+	Box ToFrame(const Box& b, int frame)
+	{
+		switch (frame)
+		{
+		case 1: return { b.left, -b.bottom, b.right, -b.top };
+		case 2: return { b.top, b.left, b.bottom, b.right };
+		case 3: return { b.top, -b.right, b.bottom, -b.left };
+		default: return b;
+		}
+	}
+
+	// keeps the lines with a * m + b * c <= d, the tolerance errs towards keeping lines
+	void Clip(const vector<pair<double, double>>& in, double a, double b, double d, vector<pair<double, double>>& out)
+	{
+		const double eps = 1e-9 * (1 + fabs(d));
+		out.clear();
+		for (size_t i = 0; i < in.size(); ++i)
+		{
+			const pair<double, double>& p = in[i];
+			const pair<double, double>& q = in[(i + 1) % in.size()];
+			double fp = a * p.first + b * p.second - d;
+			double fq = a * q.first + b * q.second - d;
+			if (fp <= eps) out.push_back(p);
+			if ((fp <= eps) != (fq <= eps))
+			{
+				double t = fp / (fp - fq);
+				out.push_back({ p.first + (q.first - p.first) * t, p.second + (q.second - p.second) * t });
+			}
+		}
+	}
+
+	// lines y = m * x + c with m >= 0 meeting the box: its top right corner on or above the line and
+	// its bottom left corner on or below it
+	bool ClipToBox(const vector<pair<double, double>>& in, const Box& box, vector<pair<double, double>>& out)
+	{
+		vector<pair<double, double>> tmp;
+		Clip(in, -box.right, -1, -box.top, tmp);
+		if (tmp.empty()) return false;
+		Clip(tmp, box.left, 1, box.bottom, out);
+		return !out.empty();
+	}
+
+	Box TileBox(int left, int top, int right, int bottom)
+	{
+		return { (double)left, (double)top, (double)right + 1, (double)bottom + 1 };
+	}
+
+	TileRect ToTileRect(const VisibilityRegion& r)
+	{
+		return { r.left, r.top, r.right, r.bottom };
+	}
+
+	Box Intersection(const NavPolygon& p, const VisibilityRegion& r)
+	{
+		return TileBox(max(p.left, r.left), max(p.top, r.top), min(p.right, r.right), min(p.bottom, r.bottom));
+	}
+}
+
+MapVisibility::MapVisibility()
+	: originX(0), originY(0), width(0), height(0), roomCount(0), wordsPerRegion(0)
+{
+}
+
+MapVisibility::~MapVisibility()
+{
+}
+
+void MapVisibility::Build(const MapGenerator& gen)
+{
+	regions.clear();
+	bits.clear();
+	regionIndex.Clear();
+	roomCount = 0;
+	wordsPerRegion = 0;
+
+	if (!gen.IsFinished())
+	{
+		return;
+	}
+
+	originX = gen.Left();
+	originY = gen.Top();
+	width = gen.Right() - gen.Left() + 1;
+	height = gen.Bottom() - gen.Top() + 1;
+
+	// rooms are only visible through their walkable interior
+	const vector<Cell>& cells = gen.GetCells();
+	for (size_t i = 0; i < cells.size(); ++i)
+	{
+		const Cell& c = cells[i];
+		if (!c.room || c.discard) continue;
+		regions.push_back({ c.x + 1, c.y + 1, c.x + c.width - 2, c.y + c.height - 2, (int)i });
+	}
+	roomCount = regions.size();
+
+	const vector<Corridor>& corridors = gen.GetMergedCorridors();
+	for (auto i = corridors.begin(); i != corridors.end(); ++i)
+	{
+		VisibilityRegion r;
+		i->rect(r.left, r.top, r.right, r.bottom);
+		r.cell = -1;
+		regions.push_back(r);
+	}
+
+	vector<TileRect> rects(regions.size());
+	transform(regions.begin(), regions.end(), rects.begin(), ToTileRect);
+	regionIndex.Build(rects);
+
+	navMesh.Build(gen);
+	const vector<NavPolygon>& polygons = navMesh.GetPolygons();
+	polygonRooms.assign(polygons.size(), vector<int>());
+	onPath.assign(polygons.size(), 0);
+	for (size_t r = 0; r < roomCount; ++r)
+	{
+		navMesh.GetPolygonIndex().ForEachOverlap(rects[r], [this, r](int p) { polygonRooms[p].push_back((int)r); });
+	}
+
+	wordsPerRegion = (roomCount + 63) / 64;
+	bits.resize(regions.size() * wordsPerRegion);
+
+	for (size_t i = 0; i < regions.size(); ++i)
+	{
+		// touching regions see each other through the shared edge
+		const VisibilityRegion& from = regions[i];
+		for (size_t j = 0; j < roomCount; ++j)
+		{
+			const VisibilityRegion& to = regions[j];
+			if (from.left <= to.right + 1 && to.left <= from.right + 1 && from.top <= to.bottom + 1 && to.top <= from.bottom + 1)
+			{
+				SetVisible(i, j);
+			}
+		}
+
+		for (int frame = 0; frame < NumFrames; ++frame)
+		{
+			FindVisibleRooms(i, frame);
+		}
+	}
+
+	polygonRooms.clear();
+	onPath.clear();
+	navMesh = NavMesh();
+}
+
+void MapVisibility::FindVisibleRooms(size_t region, int frame)
+{
+	// every line with a slope in [0, 1] that can reach the map has |c| below this
+	const double extent = 2.0 * (max(abs(originX), abs(originX + width)) + max(abs(originY), abs(originY + height)) + 1);
+	const LineSet all = { { 0, -extent }, { 1, -extent }, { 1, extent }, { 0, extent } };
+
+	const vector<NavPolygon>& polygons = navMesh.GetPolygons();
+	LineSet lines;
+	navMesh.GetPolygonIndex().ForEachOverlap(ToTileRect(regions[region]), [&](int p)
+	{
+		// lines starting in the part of the region inside this polygon
+		if (!ClipToBox(all, ToFrame(Intersection(polygons[p], regions[region]), frame), lines)) return;
+		TraversePortals(region, frame, p, lines);
+	});
+}
+
+void MapVisibility::TraversePortals(size_t region, int frame, int polygon, const LineSet& lines)
+{
+	// polygons are convex, so a line meeting two boxes inside the same polygon is walkable between them,
+	// and a chain of such pieces from the region to a room covers the straight segment between the two
+	const NavPolygon& p = navMesh.GetPolygons()[polygon];
+	const vector<NavPortal>& portals = navMesh.GetPortals();
+
+	LineSet clipped;
+	const vector<int>& rooms = polygonRooms[polygon];
+	for (auto r = rooms.begin(); r != rooms.end(); ++r)
+	{
+		if (IsVisible(region, *r)) continue;
+		if (ClipToBox(lines, ToFrame(Intersection(p, regions[*r]), frame), clipped))
+		{
+			SetVisible(region, *r);
+		}
+	}
+
+	onPath[polygon] = 1;
+	for (int i = p.firstPortal; i < p.firstPortal + p.portalCount; ++i)
+	{
+		const NavPortal& portal = portals[i];
+		if (onPath[portal.neighbor]) continue;
+
+		Box edge = { (double)min(portal.sx, portal.tx), (double)min(portal.sy, portal.ty), (double)max(portal.sx, portal.tx), (double)max(portal.sy, portal.ty) };
+		if (ClipToBox(lines, ToFrame(edge, frame), clipped))
+		{
+			TraversePortals(region, frame, portal.neighbor, clipped);
+		}
+	}
+	onPath[polygon] = 0;
+}
+
+int MapVisibility::FindRegion(int x, int y) const
+{
+	// rooms have the lower indices, so they take precedence over the corridors crossing them
+	return regionIndex.Find(x, y);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "BucketGrid.h"
+#include "MapGenerator.h"
+#include "NavMesh.h"
+#include <cstdint>
+#include <vector>
+
+struct VisibilityRegion
+{
+	int left;
+	int top;
+	int right;
+	int bottom;
+	int cell;		// index into MapGenerator::GetCells(), -1 for corridors
+};
+
+// Precomputed potentially visible set: for every room and corridor segment,
+// a bitset of the rooms that can be seen from somewhere inside it.
+class MapVisibility
+{
+public:
+	MapVisibility();
+	~MapVisibility();
+
+	// a room is visible from a region when a straight line runs from one to the other through walkable
+	// space, found by following the lines through the portals of the map's NavMesh; lines grazing a wall
+	// count as clear, so the sets may hold a few extra rooms but never miss a visible one
+	void Build(const MapGenerator& gen);
+
+	// regions [0, GetRoomCount()) are rooms, the rest are corridors
+	size_t GetRegionCount() const { return regions.size(); }
+	size_t GetRoomCount() const { return roomCount; }
+	const VisibilityRegion& GetRegion(size_t region) const { return regions[region]; }
+
+	// region containing the given map coordinate, rooms take precedence over corridors, -1 if none
+	int FindRegion(int x, int y) const;
+
+	bool IsVisible(size_t region, size_t room) const { return (bits[region * wordsPerRegion + room / 64] >> (room % 64)) & 1; }
+
+	const uint64_t* GetVisibleRooms(size_t region) const { return &bits[region * wordsPerRegion]; }
+	size_t GetWordsPerRegion() const { return wordsPerRegion; }
+
+private:
+	// lines y = m * x + c as a convex polygon of (m, c), in a frame where the slopes are in [0, 1]
+	typedef std::vector<std::pair<double, double>> LineSet;
+
+	void FindVisibleRooms(size_t region, int frame);
+	void TraversePortals(size_t region, int frame, int polygon, const LineSet& lines);
+
+	void SetVisible(size_t region, size_t room) { bits[region * wordsPerRegion + room / 64] |= uint64_t(1) << (room % 64); }
+
+private:
+	int								originX;
+	int								originY;
+	int								width;
+	int								height;
+
+	size_t							roomCount;
+	size_t							wordsPerRegion;
+	std::vector<VisibilityRegion>	regions;
+	std::vector<uint64_t>			bits;
+
+	// walkable space while building: the rooms overlapping every polygon, and the polygons on the current path
+	NavMesh							navMesh;
+	std::vector<std::vector<int>>	polygonRooms;
+	std::vector<char>				onPath;
+
+	// regions by the buckets they overlap, rooms come first in every bucket
+	BucketGrid						regionIndex;
+};
@@ -0,0 +1,104 @@
+#include "MultiLevelGenerator.h"
+#include "Parallel.h"
+#include <atomic>
+
+using namespace std;
+
+namespace
+{
+	const int MaxLevelAttempts = 8;
+}
+
+MultiLevelGenerator::MultiLevelGenerator()
+{
+}
+
+MultiLevelGenerator::~MultiLevelGenerator()
+{
+}
+
+bool MultiLevelGenerator::Generate(int levelCount, unsigned int seed, int cellCount, int randomRadius, int minSideLength, int maxSideLength, unsigned int threadCount)
+{
+	levels.clear();
+	offsetX.clear();
+	offsetY.clear();
+	stairs.clear();
+
+	if (levelCount <= 0)
+	{
+		return false;
+	}
+
+	levels.resize(levelCount);
+
+	atomic<bool> failed(false);
+
+	ParallelFor(levelCount, threadCount, [&](int i)
+	{
+		MapGenerator& level = levels[i];
+
+		// a level without rooms has nowhere to put its stairs, regenerate it from the next derived
+		// seed; attempt 0 keeps LevelSeed(seed, i), so levels that have rooms do not change
+		bool hasRooms = false;
+		for (int attempt = 0; attempt < MaxLevelAttempts && !hasRooms; ++attempt)
+		{
+			level = MapGenerator();
+			level.SetSeed(LevelSeed(seed, i + attempt * levelCount));
+			level.Start(cellCount, randomRadius, minSideLength, maxSideLength);
+			if (!level.IsStarted())
+			{
+				break;
+			}
+
+			while (!level.IsFinished())
+			{
+				level.Update();
+			}
+
+			hasRooms = level.GenEntryAndExit();
+		}
+
+		if (!hasRooms)
+		{
+			failed = true;
+		}
+		return hasRooms;
+	});
+
+	if (failed)
+	{
+		levels.clear();
+		return false;
+	}
+
+	LinkStairs();
+
+	return true;
+}
+
+unsigned int MultiLevelGenerator::LevelSeed(unsigned int seed, int level)
+{
+	return MapGenerator::DeriveSeed(seed, level);
+}
+
+void MultiLevelGenerator::LinkStairs()
+{
+	const size_t len = levels.size();
+	offsetX.resize(len);
+	offsetY.resize(len);
+	stairs.resize(len - 1);
+
+	offsetX[0] = 0;
+	offsetY[0] = 0;
+
+	for (size_t i = 0; i + 1 < len; ++i)
+	{
+		int x = offsetX[i] + levels[i].ExitX();
+		int y = offsetY[i] + levels[i].ExitY();
+
+		offsetX[i + 1] = x - levels[i + 1].EntryX();
+		offsetY[i + 1] = y - levels[i + 1].EntryY();
+
+		stairs[i] = { (int)i, x, y };
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "MapGenerator.h"
+#include <vector>
+
+struct Stair
+{
+	int fromLevel;
+	int x;
+	int y;
+};
+
+class MultiLevelGenerator
+{
+public:
+	MultiLevelGenerator();
+	~MultiLevelGenerator();
+
+	// generates every level on its own thread (threadCount == 0 uses all cores),
+	// then shifts the levels so that the exit of level i sits on the entry of level i + 1.
+	// a level that ends up without rooms is regenerated from another derived seed, Generate fails
+	// when that keeps happening
+	bool Generate(int levelCount, unsigned int seed, int cellCount, int randomRadius, int minSideLength, int maxSideLength, unsigned int threadCount = 0);
+
+	size_t GetLevelCount() const { return levels.size(); }
+	const MapGenerator& GetLevel(size_t level) const { return levels[level]; }
+
+	// offset to add to the coordinates of a level to get world coordinates
+	int OffsetX(size_t level) const { return offsetX[level]; }
+	int OffsetY(size_t level) const { return offsetY[level]; }
+
+	// stairs[i] connects the exit of level i with the entry of level i + 1, in world coordinates
+	const std::vector<Stair>& GetStairs() const { return stairs; }
+
+	static unsigned int LevelSeed(unsigned int seed, int level);
+
+private:
+	void LinkStairs();
+
+private:
+	std::vector<MapGenerator>	levels;
+	std::vector<int>			offsetX;
+	std::vector<int>			offsetY;
+	std::vector<Stair>			stairs;
+};
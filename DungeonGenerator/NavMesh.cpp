@@ -0,0 +1,131 @@
+#include "NavMesh.h"
+#include "RectUnion.h"
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+NavMesh::NavMesh()
+{
+}
+
+NavMesh::~NavMesh()
+{
+}
+
+void NavMesh::Build(const MapGenerator& gen)
+{
+	polygons.clear();
+	portals.clear();
+	polygonIndex.Clear();
+
+	if (!gen.IsFinished()) return;
+
+	// rooms lose their wall border, as in Gen2DArrayMap, corridors carve through it
+	vector<TileRect> rects;
+	const vector<Cell>& cells = gen.GetCells();
+	for (auto c = cells.begin(); c != cells.end(); ++c)
+	{
+		if (c->discard) continue;
+		int border = c->room ? 1 : 0;
+		rects.push_back({ c->x + border, c->y + border, c->x + c->width - 1 - border, c->y + c->height - 1 - border });
+	}
+
+	const vector<Corridor>& corridors = gen.GetMergedCorridors();
+	for (auto i = corridors.begin(); i != corridors.end(); ++i)
+	{
+		TileRect r;
+		i->rect(r.left, r.top, r.right, r.bottom);
+		rects.push_back(r);
+	}
+
+	vector<TileRect> pieces;
+	UnionRectsBestAxis(rects, pieces);
+
+	const int len = (int)pieces.size();
+
+	// polygons by the coordinate of their left and top edges, sorted along the other axis
+	unordered_map<int, vector<int>> byLeft, byTop;
+	for (int i = 0; i < len; ++i)
+	{
+		byLeft[pieces[i].left].push_back(i);
+		byTop[pieces[i].top].push_back(i);
+	}
+	for (auto i = byLeft.begin(); i != byLeft.end(); ++i)
+	{
+		sort(i->second.begin(), i->second.end(), [&pieces](int a, int b) { return pieces[a].top < pieces[b].top; });
+	}
+	for (auto i = byTop.begin(); i != byTop.end(); ++i)
+	{
+		sort(i->second.begin(), i->second.end(), [&pieces](int a, int b) { return pieces[a].left < pieces[b].left; });
+	}
+
+	// find every shared edge once from the left or upper side, then store it for both polygons
+	vector<NavPortal> edges;
+	vector<int> owner;
+	auto link = [&edges, &owner](int a, int b, int sx, int sy, int tx, int ty)
+	{
+		edges.push_back({ b, sx, sy, tx, ty });
+		owner.push_back(a);
+		edges.push_back({ a, sx, sy, tx, ty });
+		owner.push_back(b);
+	};
+
+	for (int a = 0; a < len; ++a)
+	{
+		const TileRect& r = pieces[a];
+
+		auto right = byLeft.find(r.right + 1);
+		if (right != byLeft.end())
+		{
+			const vector<int>& list = right->second;
+			auto first = lower_bound(list.begin(), list.end(), r.top, [&pieces](int i, int y) { return pieces[i].bottom < y; });
+			for (auto i = first; i != list.end() && pieces[*i].top <= r.bottom; ++i)
+			{
+				const TileRect& n = pieces[*i];
+				if (n.bottom < r.top) continue;
+				link(a, *i, n.left, max(r.top, n.top), n.left, min(r.bottom, n.bottom) + 1);
+			}
+		}
+
+		auto below = byTop.find(r.bottom + 1);
+		if (below != byTop.end())
+		{
+			const vector<int>& list = below->second;
+			auto first = lower_bound(list.begin(), list.end(), r.left, [&pieces](int i, int x) { return pieces[i].right < x; });
+			for (auto i = first; i != list.end() && pieces[*i].left <= r.right; ++i)
+			{
+				const TileRect& n = pieces[*i];
+				if (n.right < r.left) continue;
+				link(a, *i, max(r.left, n.left), n.top, min(r.right, n.right) + 1, n.top);
+			}
+		}
+	}
+
+	// group portals by polygon
+	polygons.resize(len);
+	for (int i = 0; i < len; ++i)
+	{
+		polygons[i] = { pieces[i].left, pieces[i].top, pieces[i].right, pieces[i].bottom, 0, 0 };
+	}
+	for (auto o = owner.begin(); o != owner.end(); ++o)
+	{
+		polygons[*o].portalCount++;
+	}
+	int offset = 0;
+	for (int i = 0; i < len; ++i)
+	{
+		polygons[i].firstPortal = offset;
+		offset += polygons[i].portalCount;
+		polygons[i].portalCount = 0;
+	}
+
+	portals.resize(edges.size());
+	for (size_t i = 0; i < edges.size(); ++i)
+	{
+		NavPolygon& p = polygons[owner[i]];
+		portals[p.firstPortal + p.portalCount++] = edges[i];
+	}
+
+	polygonIndex.Build(pieces);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "BucketGrid.h"
+#include "MapGenerator.h"
+#include <vector>
+
+// walkable tiles [left, right] x [top, bottom], in map coordinates
+struct NavPolygon
+{
+	int left;
+	int top;
+	int right;
+	int bottom;
+	int firstPortal;
+	int portalCount;
+};
+
+// edge shared with a neighbouring polygon, in tile corner coordinates
+struct NavPortal
+{
+	int neighbor;
+	int sx, sy, tx, ty;
+};
+
+// Navigation mesh made of disjoint rectangles covering the walkable area of a generated map:
+// room interiors, kept filler cells and corridors. Every polygon lists its portals contiguously.
+class NavMesh
+{
+public:
+	NavMesh();
+	~NavMesh();
+
+	void Build(const MapGenerator& gen);
+
+	const std::vector<NavPolygon>& GetPolygons() const { return polygons; }
+	const std::vector<NavPortal>& GetPortals() const { return portals; }
+
+	// polygon containing the tile, -1 when the tile is not walkable
+	int FindPolygon(int x, int y) const { return polygonIndex.Find(x, y); }
+
+	// the polygons' rectangles by the buckets they overlap, for area queries
+	const BucketGrid& GetPolygonIndex() const { return polygonIndex; }
+
+private:
+	std::vector<NavPolygon>	polygons;
+	std::vector<NavPortal>	portals;
+	BucketGrid				polygonIndex;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// threads to use for count items: threadCount, all cores when it is 0, at least one and no more than count
+inline unsigned int ThreadCount(unsigned int threadCount, long long count)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount == 0)
+	{
+		threadCount = 1;
+	}
+	if (count > 0 && threadCount > (unsigned long long)count)
+	{
+		threadCount = count;
+	}
+	return threadCount;
+}
+
+// calls fn(item) for every item in [0, count) on ThreadCount(threadCount, count) threads, the calling
+// thread included; Index is any integer type. Items are handed out in increasing order through an
+// atomic counter, and a thread stops taking items once fn returns false for one of them
+template <typename Index, typename Func>
+void ParallelFor(Index count, unsigned int threadCount, Func fn)
+{
+	if (count <= 0) return;
+
+	std::atomic<Index> next(0);
+	auto worker = [&]()
+	{
+		for (Index i = next++; i < count; i = next++)
+		{
+			if (!fn(i)) return;
+		}
+	};
+
+	threadCount = ThreadCount(threadCount, count);
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < threadCount; ++i)
+	{
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto t = workers.begin(); t != workers.end(); ++t)
+	{
+		t->join();
+	}
+}
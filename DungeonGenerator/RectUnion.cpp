@@ -0,0 +1,205 @@
+#include "RectUnion.h"
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+void UnionRects(const vector<TileRect>& rects, vector<TileRect>& result)
+{
+	result.clear();
+
+	vector<pair<int, int>> events;
+	events.reserve(rects.size() * 2);
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		if (rects[i].right < rects[i].left || rects[i].bottom < rects[i].top) continue;
+		events.push_back({ rects[i].top, (int)i + 1 });
+		events.push_back({ rects[i].bottom + 1, -(int)i - 1 });
+	}
+	sort(events.begin(), events.end());
+
+	vector<int> active;
+	vector<size_t> activePos(rects.size());
+	vector<pair<int, int>> intervals;
+
+	// open rectangles of the previous band, sorted by left, and their spans in this band
+	vector<size_t> open, nextOpen;
+	vector<pair<int, int>> spans;
+
+	for (size_t e = 0; e < events.size();)
+	{
+		const int y = events[e].first;
+		for (; e < events.size() && events[e].first == y; ++e)
+		{
+			int id = events[e].second;
+			if (id > 0)
+			{
+				activePos[id - 1] = active.size();
+				active.push_back(id - 1);
+			}
+			else
+			{
+				size_t pos = activePos[-id - 1];
+				active[pos] = active.back();
+				activePos[active[pos]] = pos;
+				active.pop_back();
+			}
+		}
+
+		intervals.clear();
+		for (auto i = active.begin(); i != active.end(); ++i)
+		{
+			intervals.push_back({ rects[*i].left, rects[*i].right });
+		}
+		sort(intervals.begin(), intervals.end());
+
+		spans.clear();
+		for (auto i = intervals.begin(); i != intervals.end(); ++i)
+		{
+			if (!spans.empty() && i->first <= spans.back().second + 1)
+			{
+				spans.back().second = max(spans.back().second, i->second);
+			}
+			else
+			{
+				spans.push_back(*i);
+			}
+		}
+
+		// rows stay the same until the next event, extend the rectangles whose span did not change
+		const int bottom = (e < events.size() ? events[e].first : y) - 1;
+		nextOpen.clear();
+		size_t o = 0;
+		for (auto s = spans.begin(); s != spans.end(); ++s)
+		{
+			while (o < open.size() && result[open[o]].left < s->first) ++o;
+			if (o < open.size() && result[open[o]].left == s->first && result[open[o]].right == s->second)
+			{
+				result[open[o]].bottom = bottom;
+				nextOpen.push_back(open[o]);
+				++o;
+			}
+			else
+			{
+				nextOpen.push_back(result.size());
+				result.push_back({ s->first, y, s->second, bottom });
+			}
+		}
+		open.swap(nextOpen);
+	}
+}
+
+void UnionRectsBestAxis(const vector<TileRect>& rects, vector<TileRect>& result)
+{
+	UnionRects(rects, result);
+
+	vector<TileRect> transposed(rects.size());
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		transposed[i] = { rects[i].top, rects[i].left, rects[i].bottom, rects[i].right };
+	}
+
+	vector<TileRect> columns;
+	UnionRects(transposed, columns);
+
+	if (columns.size() < result.size())
+	{
+		result.resize(columns.size());
+		for (size_t i = 0; i < columns.size(); ++i)
+		{
+			result[i] = { columns[i].top, columns[i].left, columns[i].bottom, columns[i].right };
+		}
+	}
+}
+
+void FlattenRects(const vector<TileRect>& rects, const vector<int>& labels, vector<TileRect>& result, vector<int>& resultLabels)
+{
+	result.clear();
+	resultLabels.clear();
+
+	int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+	for (auto r = rects.begin(); r != rects.end(); ++r)
+	{
+		if (r->right < r->left || r->bottom < r->top) continue;
+		minX = min(minX, r->left);
+		minY = min(minY, r->top);
+		maxX = max(maxX, r->right);
+		maxY = max(maxY, r->bottom);
+	}
+	if (minX > maxX) return;
+
+	// the painted pieces are listed in every bucket they overlap, buckets grow until there are
+	// at most a few per rectangle
+	int shift = 4;
+	while (((long long)((maxX - minX) >> shift) + 1) * (((maxY - minY) >> shift) + 1) > max((long long)rects.size() * 4, 64LL)) ++shift;
+	const int bucketsX = ((maxX - minX) >> shift) + 1;
+
+	struct Piece
+	{
+		TileRect rect;
+		int label;
+		int seen;		// last rectangle that tested it
+		bool alive;
+	};
+
+	vector<Piece> pieces;
+	vector<int> head(bucketsX * (((maxY - minY) >> shift) + 1), -1);
+	vector<pair<int, int>> nodes;	// (piece, next node in the bucket)
+	pieces.reserve(rects.size() * 4);
+	nodes.reserve(rects.size() * 8);
+
+	auto add_piece = [&](const TileRect& r, int label, int stamp)
+	{
+		const int piece = (int)pieces.size();
+		pieces.push_back({ r, label, stamp, true });
+		for (int by = (r.top - minY) >> shift; by <= (r.bottom - minY) >> shift; ++by)
+		{
+			for (int bx = (r.left - minX) >> shift; bx <= (r.right - minX) >> shift; ++bx)
+			{
+				int& first = head[by * bucketsX + bx];
+				nodes.push_back({ piece, first });
+				first = (int)nodes.size() - 1;
+			}
+		}
+	};
+
+	// paint in order, every piece the new rectangle overlaps is replaced by what is left of it
+	for (int i = 0; i < (int)rects.size(); ++i)
+	{
+		const TileRect r = rects[i];
+		if (r.right < r.left || r.bottom < r.top) continue;
+
+		for (int by = (r.top - minY) >> shift; by <= (r.bottom - minY) >> shift; ++by)
+		{
+			for (int bx = (r.left - minX) >> shift; bx <= (r.right - minX) >> shift; ++bx)
+			{
+				for (int n = head[by * bucketsX + bx]; n >= 0; n = nodes[n].second)
+				{
+					Piece& p = pieces[nodes[n].first];
+					if (!p.alive || p.seen == i) continue;
+					p.seen = i;
+
+					const TileRect q = p.rect;
+					if (q.right < r.left || q.left > r.right || q.bottom < r.top || q.top > r.bottom) continue;
+
+					p.alive = false;
+					const int label = p.label;
+					const int top = max(q.top, r.top), bottom = min(q.bottom, r.bottom);
+					if (q.top < r.top) add_piece({ q.left, q.top, q.right, r.top - 1 }, label, i);
+					if (q.bottom > r.bottom) add_piece({ q.left, r.bottom + 1, q.right, q.bottom }, label, i);
+					if (q.left < r.left) add_piece({ q.left, top, r.left - 1, bottom }, label, i);
+					if (q.right > r.right) add_piece({ r.right + 1, top, q.right, bottom }, label, i);
+				}
+			}
+		}
+
+		add_piece(r, labels[i], i);
+	}
+
+	for (auto p = pieces.begin(); p != pieces.end(); ++p)
+	{
+		if (!p->alive) continue;
+		result.push_back(p->rect);
+		resultLabels.push_back(p->label);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+struct TileRect
+{
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+// Splits the union of inclusive tile rectangles into disjoint ones: every row is reduced to
+// its maximal spans, and runs of rows with the same span are merged into one rectangle.
+void UnionRects(const std::vector<TileRect>& rects, std::vector<TileRect>& result);
+
+// UnionRects along rows and along columns, keeping whichever result has fewer rectangles.
+void UnionRectsBestAxis(const std::vector<TileRect>& rects, std::vector<TileRect>& result);
+
+// Splits rectangles painted in order into disjoint ones: every tile goes to the last rectangle that
+// covers it and resultLabels[i] is the label of that rectangle. Tiles no rectangle covers are left out.
+// A rectangle only splits the pieces it overlaps, found through a bucket grid, so the cost follows the
+// number of rectangles and overlaps rather than the area.
+void FlattenRects(const std::vector<TileRect>& rects, const std::vector<int>& labels, std::vector<TileRect>& result, std::vector<int>& resultLabels);
@@ -0,0 +1,197 @@
+#include "RoomGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+using namespace std;
+
+RoomGraph::RoomGraph()
+	: diameterFrom(-1), diameterTo(-1), diameter(0)
+{
+}
+
+RoomGraph::~RoomGraph()
+{
+}
+
+void RoomGraph::Build(const MapGenerator& gen)
+{
+	rooms.clear();
+	cellNodes.clear();
+	firstEdge.clear();
+	adjacency.clear();
+	weights.clear();
+	diameterFrom = diameterTo = -1;
+	diameter = 0;
+	approxEccentricity.clear();
+	articulationNodes.clear();
+
+	if (!gen.IsFinished()) return;
+
+	const vector<Cell>& cells = gen.GetCells();
+	const vector<bool>& connections = gen.GetConnections();
+	const size_t len = cells.size();
+
+	cellNodes.assign(len, -1);
+	for (size_t i = 0; i < len; ++i)
+	{
+		if (!cells[i].room || cells[i].discard) continue;
+		cellNodes[i] = (int)rooms.size();
+		rooms.push_back((int)i);
+	}
+
+	// the matrix is symmetric, so scanning row by row lists every node's neighbours in cell order
+	firstEdge.push_back(0);
+	for (auto r = rooms.begin(); r != rooms.end(); ++r)
+	{
+		const Cell& a = cells[*r];
+		for (size_t j = 0; j < len; ++j)
+		{
+			if (cellNodes[j] < 0 || !connections[*r * len + j]) continue;
+			const Cell& b = cells[j];
+			adjacency.push_back(cellNodes[j]);
+			weights.push_back(fabs(a.cx() - b.cx()) + fabs(a.cy() - b.cy()));
+		}
+		firstEdge.push_back((int)adjacency.size());
+	}
+
+	if (rooms.empty()) return;
+
+	vector<float> distFrom, distTo;
+	ShortestPaths(0, distFrom);
+	diameterFrom = Farthest(distFrom);
+	ShortestPaths(diameterFrom, distFrom);
+	diameterTo = Farthest(distFrom);
+	diameter = distFrom[diameterTo];
+	ShortestPaths(diameterTo, distTo);
+
+	approxEccentricity.resize(rooms.size());
+	for (size_t i = 0; i < rooms.size(); ++i)
+	{
+		approxEccentricity[i] = max(distFrom[i], distTo[i]);
+	}
+
+	FindArticulationNodes();
+}
+
+int RoomGraph::FindNode(int cell) const
+{
+	if (cell < 0 || cell >= (int)cellNodes.size()) return -1;
+	return cellNodes[cell];
+}
+
+void RoomGraph::ShortestPaths(int source, vector<float>& dist) const
+{
+	dist.assign(rooms.size(), -1.0f);
+	if (source < 0 || source >= (int)rooms.size()) return;
+
+	typedef pair<float, int> Entry;
+	priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+	dist[source] = 0;
+	open.push({ 0.0f, source });
+
+	while (!open.empty())
+	{
+		Entry e = open.top();
+		open.pop();
+		int n = e.second;
+		if (e.first > dist[n]) continue;
+
+		for (int i = firstEdge[n]; i < firstEdge[n + 1]; ++i)
+		{
+			int m = adjacency[i];
+			float d = e.first + weights[i];
+			if (dist[m] < 0 || d < dist[m])
+			{
+				dist[m] = d;
+				open.push({ d, m });
+			}
+		}
+	}
+}
+
+float RoomGraph::Eccentricity(int node) const
+{
+	vector<float> dist;
+	ShortestPaths(node, dist);
+	float ecc = 0;
+	for (auto i = dist.begin(); i != dist.end(); ++i)
+	{
+		ecc = max(ecc, *i);
+	}
+	return ecc;
+}
+
+int RoomGraph::Farthest(const vector<float>& dist) const
+{
+	// ties go to the lower node so the result does not depend on the queue order
+	int best = 0;
+	for (int i = 1; i < (int)dist.size(); ++i)
+	{
+		if (dist[i] > dist[best]) best = i;
+	}
+	return best;
+}
+
+void RoomGraph::FindArticulationNodes()
+{
+	// Tarjan's low-link search with an explicit stack, so long chains of rooms can't overflow the call stack
+	const int n = (int)rooms.size();
+	vector<int> order(n, -1);
+	vector<int> low(n, 0);
+	vector<int> parent(n, -1);
+	vector<int> nextEdge(firstEdge.begin(), firstEdge.end() - 1);
+	vector<char> articulation(n, 0);
+	vector<int> stack;
+	int counter = 0;
+
+	for (int root = 0; root < n; ++root)
+	{
+		if (order[root] >= 0) continue;
+
+		int rootChildren = 0;
+		order[root] = low[root] = counter++;
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			int v = stack.back();
+			if (nextEdge[v] < firstEdge[v + 1])
+			{
+				int w = adjacency[nextEdge[v]++];
+				if (order[w] < 0)
+				{
+					parent[w] = v;
+					order[w] = low[w] = counter++;
+					stack.push_back(w);
+					if (v == root) ++rootChildren;
+				}
+				else if (w != parent[v])
+				{
+					low[v] = min(low[v], order[w]);
+				}
+				continue;
+			}
+
+			stack.pop_back();
+			int p = parent[v];
+			if (p < 0) continue;
+			low[p] = min(low[p], low[v]);
+			if (p != root && low[v] >= order[p])
+			{
+				articulation[p] = 1;
+			}
+		}
+
+		if (rootChildren > 1)
+		{
+			articulation[root] = 1;
+		}
+	}
+
+	for (int i = 0; i < n; ++i)
+	{
+		if (articulation[i]) articulationNodes.push_back(i);
+	}
+}
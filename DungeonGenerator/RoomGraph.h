@@ -0,0 +1,63 @@
+#pragma once
+
+#include "MapGenerator.h"
+#include <vector>
+
+// Graph of the rooms of a finished map, linked by the connections Connect() made corridors for and
+// weighted by the Manhattan distance between room centers. Reading the connection matrix is
+// O(V^2), the metrics after that cost a few O((V + E) log V) shortest path passes.
+class RoomGraph
+{
+public:
+	RoomGraph();
+	~RoomGraph();
+
+	void Build(const MapGenerator& gen);
+
+	int GetNodeCount() const { return (int)rooms.size(); }
+
+	// cell index of every node
+	const std::vector<int>& GetRooms() const { return rooms; }
+	// node of a cell, -1 for cells that are not rooms
+	int FindNode(int cell) const;
+
+	// neighbours of node n are adjacency[firstEdge[n]] .. adjacency[firstEdge[n + 1] - 1]
+	const std::vector<int>& GetFirstEdge() const { return firstEdge; }
+	const std::vector<int>& GetAdjacency() const { return adjacency; }
+	const std::vector<float>& GetWeights() const { return weights; }
+
+	// shortest path length from source to every node, -1 for nodes in other components
+	void ShortestPaths(int source, std::vector<float>& dist) const;
+	// exact eccentricity of one node within its component, one shortest path pass
+	float Eccentricity(int node) const;
+
+	// double sweep from the first room: the farthest node from it, then the farthest node from that
+	// one. exact on trees, a lower bound on the diameter of the first room's component otherwise
+	int GetDiameterFrom() const { return diameterFrom; }
+	int GetDiameterTo() const { return diameterTo; }
+	float GetDiameter() const { return diameter; }
+
+	// distance to the farther diameter endpoint, a lower bound on every node's eccentricity;
+	// -1 outside the first room's component
+	const std::vector<float>& GetApproxEccentricity() const { return approxEccentricity; }
+
+	// rooms whose removal splits their component, in node order
+	const std::vector<int>& GetArticulationNodes() const { return articulationNodes; }
+
+private:
+	int Farthest(const std::vector<float>& dist) const;
+	void FindArticulationNodes();
+
+private:
+	std::vector<int>	rooms;
+	std::vector<int>	cellNodes;
+	std::vector<int>	firstEdge;
+	std::vector<int>	adjacency;
+	std::vector<float>	weights;
+
+	int					diameterFrom;
+	int					diameterTo;
+	float				diameter;
+	std::vector<float>	approxEccentricity;
+	std::vector<int>	articulationNodes;
+};
@@ -0,0 +1,105 @@
+#include "SeedSearch.h"
+#include "Parallel.h"
+#include <atomic>
+
+using namespace std;
+
+SeedSearch::SeedSearch(int cellCount, int randomRadius, int minSideLength, int maxSideLength, PlacementStrategy placement)
+	: cellCount(cellCount), randomRadius(randomRadius), minSideLength(minSideLength), maxSideLength(maxSideLength), placement(placement)
+{
+}
+
+SeedSearch::~SeedSearch()
+{
+}
+
+void SeedSearch::AddPredicate(SearchStage stage, Predicate predicate)
+{
+	if (stage < 0 || stage >= NumSearchStage) return;
+	predicates[stage].push_back(predicate);
+}
+
+bool SeedSearch::Check(SearchStage stage, const MapGenerator& gen) const
+{
+	for (auto p = predicates[stage].begin(); p != predicates[stage].end(); ++p)
+	{
+		if (!(*p)(gen)) return false;
+	}
+	return true;
+}
+
+SearchStage SeedSearch::Test(unsigned int seed, MapGenerator& gen) const
+{
+	gen = MapGenerator();
+	gen.SetSeed(seed);
+	gen.Start(cellCount, randomRadius, minSideLength, maxSideLength, placement);
+	if (!gen.IsStarted() || !Check(AfterStart, gen)) return AfterStart;
+
+	while (!gen.IsSeparated())
+	{
+		gen.Update();
+	}
+	if (!Check(AfterSeparation, gen)) return AfterSeparation;
+
+	while (!gen.IsFinished())
+	{
+		gen.Update();
+	}
+	if (!Check(AfterConnect, gen)) return AfterConnect;
+
+	// entry and exit draw from the random engine, so only place them when somebody asks
+	if (!predicates[AfterEntryExit].empty())
+	{
+		gen.GenEntryAndExit();
+		if (!Check(AfterEntryExit, gen)) return AfterEntryExit;
+	}
+
+	return NumSearchStage;
+}
+
+bool SeedSearch::Find(unsigned int firstSeed, unsigned int seedCount, unsigned int& seed, unsigned int threadCount, SearchStats* stats) const
+{
+	atomic<unsigned int> best(seedCount);
+	atomic<unsigned int> tested(0);
+	atomic<unsigned int> rejected[NumSearchStage];
+	for (int i = 0; i < NumSearchStage; ++i)
+	{
+		rejected[i] = 0;
+	}
+
+	// seeds are handed out in order, so once a seed passes only lower ones still need testing
+	ParallelFor(seedCount, threadCount, [&](unsigned int i)
+	{
+		if (i >= best) return false;
+
+		MapGenerator gen;
+		SearchStage failed = Test(firstSeed + i, gen);
+		tested++;
+
+		if (failed != NumSearchStage)
+		{
+			rejected[failed]++;
+			return true;
+		}
+
+		unsigned int current = best;
+		while (i < current && !best.compare_exchange_weak(current, i))
+		{
+		}
+		return true;
+	});
+
+	if (nullptr != stats)
+	{
+		stats->tested = tested;
+		for (int i = 0; i < NumSearchStage; ++i)
+		{
+			stats->rejected[i] = rejected[i];
+		}
+	}
+
+	if (best >= seedCount) return false;
+
+	seed = firstSeed + best;
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "MapGenerator.h"
+#include <functional>
+#include <vector>
+
+enum SearchStage
+{
+	AfterStart = 0,		// cells are placed, possibly still overlapping
+	AfterSeparation,	// cells are final, bounds are known
+	AfterConnect,		// connections and corridors are built
+	AfterEntryExit,		// entry and exit are placed
+	NumSearchStage
+};
+
+struct SearchStats
+{
+	unsigned int tested;
+	unsigned int rejected[NumSearchStage];
+};
+
+// Looks for seeds whose maps satisfy a set of predicates. Every predicate runs at the earliest stage
+// it is registered for, and a seed is dropped at the first stage that fails, before the rest of the
+// pipeline is paid for. Predicates are called concurrently from several threads.
+class SeedSearch
+{
+public:
+	typedef std::function<bool(const MapGenerator&)> Predicate;
+
+	SeedSearch(int cellCount, int randomRadius, int minSideLength, int maxSideLength, PlacementStrategy placement = SeparationPlacement);
+	~SeedSearch();
+
+	void AddPredicate(SearchStage stage, Predicate predicate);
+
+	// lowest seed in [firstSeed, firstSeed + seedCount) passing every predicate, using threadCount threads
+	// (0 for all cores); the result does not depend on the number of threads
+	bool Find(unsigned int firstSeed, unsigned int seedCount, unsigned int& seed, unsigned int threadCount = 0, SearchStats* stats = nullptr) const;
+
+	// runs the pipeline for a single seed, returns the first failing stage or NumSearchStage if all pass
+	SearchStage Test(unsigned int seed, MapGenerator& gen) const;
+
+private:
+	bool Check(SearchStage stage, const MapGenerator& gen) const;
+
+private:
+	int							cellCount;
+	int							randomRadius;
+	int							minSideLength;
+	int							maxSideLength;
+	PlacementStrategy			placement;
+	std::vector<Predicate>		predicates[NumSearchStage];
+};
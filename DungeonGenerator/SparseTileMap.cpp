@@ -0,0 +1,75 @@
+#include "SparseTileMap.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+SparseTileMap::SparseTileMap()
+	: width(0), height(0), bricksX(0), bricksY(0), voidTile(0), allocated(0)
+{
+}
+
+SparseTileMap::~SparseTileMap()
+{
+}
+
+void SparseTileMap::Reset(int width, int height, char voidTile)
+{
+	this->width = max(width, 0);
+	this->height = max(height, 0);
+	this->voidTile = voidTile;
+	bricksX = (this->width + BrickSize - 1) >> BrickShift;
+	bricksY = (this->height + BrickSize - 1) >> BrickShift;
+	allocated = 0;
+
+	bricks.clear();
+	bricks.resize(bricksX * bricksY);
+}
+
+SparseTileMap::Brick* SparseTileMap::GetOrCreate(int bx, int by)
+{
+	unique_ptr<Brick>& brick = bricks[by * bricksX + bx];
+	if (!brick)
+	{
+		brick.reset(new Brick);
+		memset(brick->tiles, voidTile, sizeof(brick->tiles));
+		allocated++;
+	}
+	return brick.get();
+}
+
+void SparseTileMap::Set(int x, int y, char tile)
+{
+	if (x < 0 || x >= width || y < 0 || y >= height) return;
+	if (tile == voidTile && !bricks[(y >> BrickShift) * bricksX + (x >> BrickShift)]) return;
+
+	Brick* brick = GetOrCreate(x >> BrickShift, y >> BrickShift);
+	brick->tiles[((y & (BrickSize - 1)) << BrickShift) + (x & (BrickSize - 1))] = tile;
+}
+
+void SparseTileMap::FillRect(int left, int top, int right, int bottom, char tile)
+{
+	left = max(left, 0);
+	top = max(top, 0);
+	right = min(right, width - 1);
+	bottom = min(bottom, height - 1);
+	if (left > right || top > bottom) return;
+
+	for (int by = top >> BrickShift; by <= bottom >> BrickShift; ++by)
+	{
+		for (int bx = left >> BrickShift; bx <= right >> BrickShift; ++bx)
+		{
+			if (tile == voidTile && !bricks[by * bricksX + bx]) continue;
+
+			Brick* brick = GetOrCreate(bx, by);
+			const int x0 = max(left, bx << BrickShift) & (BrickSize - 1);
+			const int x1 = min(right, (bx << BrickShift) + BrickSize - 1) & (BrickSize - 1);
+			const int y0 = max(top, by << BrickShift) & (BrickSize - 1);
+			const int y1 = min(bottom, (by << BrickShift) + BrickSize - 1) & (BrickSize - 1);
+			for (int y = y0; y <= y1; ++y)
+			{
+				memset(&brick->tiles[(y << BrickShift) + x0], tile, x1 - x0 + 1);
+			}
+		}
+	}
+}
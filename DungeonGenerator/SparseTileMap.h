@@ -0,0 +1,101 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+// Tile grid stored as 64x64 bricks in a two-level table; bricks that were never written hold only
+// the void tile and are not allocated, so memory follows the painted area instead of the bounds.
+class SparseTileMap
+{
+public:
+	static const int BrickShift = 6;
+	static const int BrickSize = 1 << BrickShift;
+
+	SparseTileMap();
+	~SparseTileMap();
+
+	void Reset(int width, int height, char voidTile);
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	char GetVoidTile() const { return voidTile; }
+
+	// void tile outside the map and in unallocated bricks
+	char Get(int x, int y) const
+	{
+		if (x < 0 || x >= width || y < 0 || y >= height) return voidTile;
+		const Brick* brick = bricks[(y >> BrickShift) * bricksX + (x >> BrickShift)].get();
+		return brick ? brick->tiles[((y & (BrickSize - 1)) << BrickShift) + (x & (BrickSize - 1))] : voidTile;
+	}
+
+	void Set(int x, int y, char tile);
+
+	// inclusive rectangle, clipped to the map
+	void FillRect(int left, int top, int right, int bottom, char tile);
+
+	// calls func(start, end, tile) for every maximal run [start, end) of equal tiles in row y,
+	// unallocated bricks are reported as a single run of the void tile
+	template <typename Func>
+	void ForEachRowSpan(int y, Func func) const;
+
+	size_t AllocatedBricks() const { return allocated; }
+	size_t MemoryBytes() const { return bricks.size() * sizeof(bricks[0]) + allocated * sizeof(Brick); }
+
+private:
+	struct Brick
+	{
+		char tiles[BrickSize * BrickSize];
+	};
+
+	Brick* GetOrCreate(int bx, int by);
+
+private:
+	int									width;
+	int									height;
+	int									bricksX;
+	int									bricksY;
+	char								voidTile;
+	size_t								allocated;
+	std::vector<std::unique_ptr<Brick>>	bricks;
+};
+
+template <typename Func>
+void SparseTileMap::ForEachRowSpan(int y, Func func) const
+{
+	if (y < 0 || y >= height || width <= 0) return;
+
+	const int by = y >> BrickShift;
+	const int row = (y & (BrickSize - 1)) << BrickShift;
+
+	int start = 0;
+	char tile = Get(0, y);
+	for (int bx = 0; bx < bricksX; ++bx)
+	{
+		const int x0 = bx << BrickShift;
+		const int x1 = x0 + BrickSize < width ? x0 + BrickSize : width;
+		const Brick* brick = bricks[by * bricksX + bx].get();
+
+		if (!brick)
+		{
+			if (tile != voidTile)
+			{
+				func(start, x0, tile);
+				start = x0;
+				tile = voidTile;
+			}
+			continue;
+		}
+
+		for (int x = x0; x < x1; ++x)
+		{
+			char t = brick->tiles[row + x - x0];
+			if (t != tile)
+			{
+				func(start, x, tile);
+				start = x;
+				tile = t;
+			}
+		}
+	}
+	func(start, width, tile);
+}
@@ -0,0 +1,315 @@
+#include "WallBVH.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+	const int LeafSize = 4;
+	const int PacketSize = 8;
+	const float PacketSpread = 16.0f;
+	const float Huge = 1e30f;
+
+	inline float Reciprocal(float d)
+	{
+		return d != 0 ? 1.0f / d : Huge;
+	}
+}
+
+WallBVH::WallBVH()
+	: walkableLabel(0)
+{
+}
+
+WallBVH::~WallBVH()
+{
+}
+
+void WallBVH::Build(const vector<LineWall>& walls, int walkableLabel)
+{
+	const size_t len = walls.size();
+	this->walkableLabel = walkableLabel;
+
+	nodes.clear();
+	wallIndex.resize(len);
+	for (size_t i = 0; i < len; ++i)
+	{
+		wallIndex[i] = (int)i;
+	}
+
+	x0.resize(len);
+	y0.resize(len);
+	x1.resize(len);
+	y1.resize(len);
+	leftLabel.resize(len);
+
+	// segments are sorted in place while building, so fill them first and permute along
+	for (size_t i = 0; i < len; ++i)
+	{
+		const LineWall& w = walls[i];
+		x0[i] = (float)min(w.sx, w.tx);
+		y0[i] = (float)min(w.sy, w.ty);
+		x1[i] = (float)max(w.sx, w.tx);
+		y1[i] = (float)max(w.sy, w.ty);
+		leftLabel[i] = w.faceRight ? w.lowLabel : w.label;
+	}
+
+	if (len == 0) return;
+
+	nodes.reserve(len / LeafSize * 2 + 1);
+	BuildNode(0, (int)len);
+}
+
+int WallBVH::BuildNode(int first, int count)
+{
+	int index = (int)nodes.size();
+	nodes.push_back({ Huge, Huge, -Huge, -Huge, first, count, 0 });
+
+	Node n = nodes[index];
+	for (int i = first; i < first + count; ++i)
+	{
+		n.minX = min(n.minX, x0[i]);
+		n.minY = min(n.minY, y0[i]);
+		n.maxX = max(n.maxX, x1[i]);
+		n.maxY = max(n.maxY, y1[i]);
+	}
+
+	if (count > LeafSize)
+	{
+		// median split on segment centers along the longer axis
+		bool splitX = n.maxX - n.minX >= n.maxY - n.minY;
+		vector<int> order(count);
+		for (int i = 0; i < count; ++i) order[i] = first + i;
+
+		auto center = [this, splitX](int i) { return splitX ? x0[i] + x1[i] : y0[i] + y1[i]; };
+		nth_element(order.begin(), order.begin() + count / 2, order.end(), [&center](int a, int b) { return center(a) < center(b); });
+
+		vector<float> sx0(count), sy0(count), sx1(count), sy1(count);
+		vector<int> sidx(count);
+		vector<int> slabel(count);
+		for (int i = 0; i < count; ++i)
+		{
+			int j = order[i];
+			sx0[i] = x0[j]; sy0[i] = y0[j]; sx1[i] = x1[j]; sy1[i] = y1[j];
+			sidx[i] = wallIndex[j];
+			slabel[i] = leftLabel[j];
+		}
+		copy(sx0.begin(), sx0.end(), x0.begin() + first);
+		copy(sy0.begin(), sy0.end(), y0.begin() + first);
+		copy(sx1.begin(), sx1.end(), x1.begin() + first);
+		copy(sy1.begin(), sy1.end(), y1.begin() + first);
+		copy(sidx.begin(), sidx.end(), wallIndex.begin() + first);
+		copy(slabel.begin(), slabel.end(), leftLabel.begin() + first);
+
+		BuildNode(first, count / 2);
+		n.first = BuildNode(first + count / 2, count - count / 2);
+		n.count = 0;
+		n.axis = splitX ? 0 : 1;
+	}
+
+	nodes[index] = n;
+	return index;
+}
+
+int WallBVH::DensityAt(float x, float y) const
+{
+	if (nodes.empty()) return -1;
+
+	// the density can't change between the point and the nearest vertical wall on the +x side whose
+	// span [y0, y1) contains y, and every wall holds a single density on each side
+	float bestX = Huge;
+	int density = -1;
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const Node& n = nodes[index];
+		if (n.maxX < x || n.minX >= bestX || y < n.minY || y > n.maxY) continue;
+
+		if (n.count == 0)
+		{
+			stack[top++] = n.first;
+			stack[top++] = index + 1;
+			continue;
+		}
+
+		for (int i = n.first; i < n.first + n.count; ++i)
+		{
+			if (x0[i] != x1[i] || x0[i] < x || x0[i] >= bestX) continue;
+			if (y < y0[i] || y >= y1[i]) continue;
+			bestX = x0[i];
+			density = leftLabel[i];
+		}
+	}
+
+	return density;
+}
+
+bool WallBVH::OverlapsAABB(float minX, float minY, float maxX, float maxY) const
+{
+	if (nodes.empty()) return false;
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const Node& n = nodes[index];
+		if (n.maxX < minX || n.minX > maxX || n.maxY < minY || n.minY > maxY) continue;
+
+		if (n.count == 0)
+		{
+			stack[top++] = n.first;
+			stack[top++] = index + 1;
+			continue;
+		}
+
+		for (int i = n.first; i < n.first + n.count; ++i)
+		{
+			if (x1[i] >= minX && x0[i] <= maxX && y1[i] >= minY && y0[i] <= maxY) return true;
+		}
+	}
+
+	return false;
+}
+
+void WallBVH::QueryAABB(float minX, float minY, float maxX, float maxY, vector<int>& result) const
+{
+	result.clear();
+	if (nodes.empty()) return;
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const Node& n = nodes[index];
+		if (n.maxX < minX || n.minX > maxX || n.maxY < minY || n.minY > maxY) continue;
+
+		if (n.count == 0)
+		{
+			stack[top++] = n.first;
+			stack[top++] = index + 1;
+			continue;
+		}
+
+		for (int i = n.first; i < n.first + n.count; ++i)
+		{
+			if (x1[i] >= minX && x0[i] <= maxX && y1[i] >= minY && y0[i] <= maxY) result.push_back(wallIndex[i]);
+		}
+	}
+}
+
+bool WallBVH::Raycast(float ox, float oy, float dx, float dy, float maxT, WallHit& hit) const
+{
+	RaycastPacket<1>(&ox, &oy, &dx, &dy, &maxT, &hit);
+	return hit.wall >= 0;
+}
+
+void WallBVH::RaycastBatch(size_t count, const float* ox, const float* oy, const float* dx, const float* dy, const float* maxT, WallHit* hits) const
+{
+	size_t i = 0;
+	for (; i + PacketSize <= count; i += PacketSize)
+	{
+		// packets only pay off when the rays travel together, trace scattered ones one by one
+		bool coherent = true;
+		for (size_t k = i + 1; k < i + PacketSize; ++k)
+		{
+			coherent &= (dx[k] >= 0) == (dx[i] >= 0) && (dy[k] >= 0) == (dy[i] >= 0)
+				&& fabs(ox[k] - ox[i]) <= PacketSpread && fabs(oy[k] - oy[i]) <= PacketSpread;
+		}
+
+		if (coherent)
+		{
+			RaycastPacket<PacketSize>(ox + i, oy + i, dx + i, dy + i, maxT + i, hits + i);
+			continue;
+		}
+
+		for (size_t k = i; k < i + PacketSize; ++k)
+		{
+			RaycastPacket<1>(ox + k, oy + k, dx + k, dy + k, maxT + k, hits + k);
+		}
+	}
+	for (; i < count; ++i)
+	{
+		RaycastPacket<1>(ox + i, oy + i, dx + i, dy + i, maxT + i, hits + i);
+	}
+}
+
+template <int N>
+void WallBVH::RaycastPacket(const float* ox, const float* oy, const float* dx, const float* dy, const float* maxT, WallHit* hits) const
+{
+	float invX[N], invY[N], best[N];
+	int wall[N];
+	for (int k = 0; k < N; ++k)
+	{
+		invX[k] = Reciprocal(dx[k]);
+		invY[k] = Reciprocal(dy[k]);
+		best[k] = maxT[k];
+		wall[k] = -1;
+	}
+
+	int stack[64];
+	int top = 0;
+	if (!nodes.empty()) stack[top++] = 0;
+
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const Node& n = nodes[index];
+
+		// slab test for every lane, visit the node if any lane may still hit something closer
+		bool any = false;
+		for (int k = 0; k < N; ++k)
+		{
+			float tx0 = (n.minX - ox[k]) * invX[k];
+			float tx1 = (n.maxX - ox[k]) * invX[k];
+			float ty0 = (n.minY - oy[k]) * invY[k];
+			float ty1 = (n.maxY - oy[k]) * invY[k];
+			float tmin = max(max(min(tx0, tx1), min(ty0, ty1)), 0.0f);
+			float tmax = min(min(max(tx0, tx1), max(ty0, ty1)), best[k]);
+			any |= tmin <= tmax;
+		}
+		if (!any) continue;
+
+		// visit the child on the side the first ray comes from first, so later nodes get culled by best
+		if (n.count == 0)
+		{
+			bool forward = (n.axis == 0 ? dx[0] : dy[0]) >= 0;
+			stack[top++] = forward ? n.first : index + 1;
+			stack[top++] = forward ? index + 1 : n.first;
+			continue;
+		}
+
+		for (int i = n.first; i < n.first + n.count; ++i)
+		{
+			const bool vertical = x0[i] == x1[i];
+			for (int k = 0; k < N; ++k)
+			{
+				// distance to the wall's line, then check the hit point lies on the segment
+				float t = vertical ? (x0[i] - ox[k]) * invX[k] : (y0[i] - oy[k]) * invY[k];
+				float u = vertical ? oy[k] + t * dy[k] : ox[k] + t * dx[k];
+				float lo = vertical ? y0[i] : x0[i];
+				float hi = vertical ? y1[i] : x1[i];
+				bool parallel = vertical ? dx[k] == 0 : dy[k] == 0;
+				if (!parallel && t >= 0 && t < best[k] && u >= lo && u <= hi)
+				{
+					best[k] = t;
+					wall[k] = wallIndex[i];
+				}
+			}
+		}
+	}
+
+	for (int k = 0; k < N; ++k)
+	{
+		hits[k].wall = wall[k];
+		hits[k].t = wall[k] >= 0 ? best[k] : maxT[k];
+	}
+}
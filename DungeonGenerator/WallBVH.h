@@ -0,0 +1,58 @@
+#pragma once
+
+#include "MapMesh.h"
+#include <vector>
+
+struct WallHit
+{
+	int		wall;		// index into the wall list the tree was built from, -1 when nothing was hit
+	float	t;			// hit position is origin + t * direction
+};
+
+// Flat bounding volume hierarchy over axis-aligned walls, in the coordinates of the walls.
+class WallBVH
+{
+public:
+	WallBVH();
+	~WallBVH();
+
+	// walkableLabel is the density of the walkable tiles in the table the walls were extracted with
+	void Build(const std::vector<LineWall>& walls, int walkableLabel = 0);
+
+	// density at the given point, read from the nearest vertical wall on its +x side; -1 outside the walls
+	int DensityAt(float x, float y) const;
+	bool IsWalkable(float x, float y) const { return DensityAt(x, y) == walkableLabel; }
+
+	bool OverlapsAABB(float minX, float minY, float maxX, float maxY) const;
+	void QueryAABB(float minX, float minY, float maxX, float maxY, std::vector<int>& result) const;
+
+	// first wall hit for t in [0, maxT]; for a segment pass its end minus start as direction and maxT = 1
+	bool Raycast(float ox, float oy, float dx, float dy, float maxT, WallHit& hit) const;
+
+	// same as Raycast for count rays stored as separate arrays, traversed in packets
+	void RaycastBatch(size_t count, const float* ox, const float* oy, const float* dx, const float* dy, const float* maxT, WallHit* hits) const;
+
+private:
+	struct Node
+	{
+		float	minX, minY, maxX, maxY;
+		int		first;		// leaf: first segment, inner node: index of the second child
+		int		count;		// number of segments, 0 for inner nodes
+		int		axis;		// inner nodes: 0 when split along x, 1 along y
+	};
+
+	int BuildNode(int first, int count);
+
+	template <int N>
+	void RaycastPacket(const float* ox, const float* oy, const float* dx, const float* dy, const float* maxT, WallHit* hits) const;
+
+private:
+	std::vector<Node>	nodes;
+
+	// segments in tree order
+	std::vector<float>	x0, y0, x1, y1;
+	std::vector<int>	wallIndex;
+	std::vector<int>	leftLabel;		// vertical walls: density on the x < wall side
+
+	int					walkableLabel;
+};